@@ -0,0 +1,41 @@
+#!/bin/sh
+# Wall-clock time of starting the compiler and of compiling programs into
+# executables, by default an empty one. With a budget in milliseconds it
+# fails when compiling any of them takes longer on average, to keep startup
+# from creeping up.
+#
+# usage: benchmarks/compile.sh <compiler> [runs] [budget] [program.mila ...]
+
+compiler=${1:?usage: $0 <compiler> [runs] [budget] [program.mila ...]}
+runs=${2:-20}
+budget=${3:-0}
+shift $(($# < 3 ? $# : 3))
+programs=${*:-$(dirname "$0")/empty.mila}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+now() { date +%s%N; }
+
+# average microseconds per run of the given command
+measure() {
+    start=$(now)
+    i=0
+    while [ $i -lt "$runs" ]; do
+        "$@" < /dev/null > /dev/null 2>&1
+        i=$((i + 1))
+    done
+    echo $((($(now) - start) / runs / 1000))
+}
+
+# Printing the usage loads the compiler and does nothing else
+printf '%-20s %8sms\n' startup "$(($(measure "$compiler") / 1000))"
+status=0
+for program in $programs; do
+    us=$(measure "$compiler" "$program" "$work/out")
+    printf '%-20s %8sms\n' "$(basename "$program")" "$((us / 1000))"
+    if [ "$budget" -gt 0 ] && [ "$us" -gt $((budget * 1000)) ]; then
+        echo "over the budget of ${budget}ms" >&2
+        status=1
+    fi
+done
+exit $status
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Wall-clock time of running Mila programs through the bytecode VM, the JIT
+# and the native executable, startup and compilation included.
+#
+# usage: benchmarks/startup.sh <compiler> [runs] [program.mila ...]
+
+compiler=${1:?usage: $0 <compiler> [runs] [program.mila ...]}
+runs=${2:-20}
+shift $(($# < 2 ? $# : 2))
+programs=${*:-$(dirname "$0")/*.mila}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+now() { date +%s%N; }
+
+# average milliseconds per run of the given command
+measure() {
+    start=$(now)
+    i=0
+    while [ $i -lt "$runs" ]; do
+        "$@" < /dev/null > /dev/null 2>&1
+        i=$((i + 1))
+    done
+    echo $((($(now) - start) / runs / 1000000))
+}
+
+printf '%-20s %10s %10s %10s %10s\n' program vm run run-O2 native-O2
+for program in $programs; do
+    native() {
+        "$compiler" -O2 "$program" "$work/out" > /dev/null 2>&1 && "$work/out.bin"
+    }
+    printf '%-20s %8sms %8sms %8sms %8sms\n' "$(basename "$program")" \
+        "$(measure "$compiler" --vm "$program")" \
+        "$(measure "$compiler" --run "$program")" \
+        "$(measure "$compiler" --run -O2 "$program")" \
+        "$(measure native)"
+done
@@ -0,0 +1,79 @@
+#include "include/ServerProtocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/un.h>
+
+
+// Compiles through a running `mila --server`, with the same arguments and output as mila itself
+int main(int argc, char* args[]) {
+    std::string socketPath = default_server_socket();
+    std::vector<std::string> arguments;
+    std::string fileName;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = args[i];
+        if (arg.rfind("--socket=", 0) == 0)
+            socketPath = arg.substr(9);
+        else {
+            if (fileName.empty() && (arg.size() <= 1 || arg[0] != '-'))
+                fileName = arg;
+            arguments.push_back(arg);
+        }
+    }
+
+    std::string source;
+    if (!fileName.empty()) {
+        std::ifstream file(fileName);
+        if (file.fail()) {
+            std::cout << "File not open" << std::endl;
+            return 1;
+        }
+        std::ostringstream reading;
+        reading << file.rdbuf();
+        source = reading.str();
+    }
+    char directory[4096];
+    if (!getcwd(directory, sizeof(directory))) {
+        std::cerr << "ERROR:\tCannot get the working directory: " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketPath.size() >= sizeof(address.sun_path) || connection < 0) {
+        std::cerr << "ERROR:\tCannot connect to " << socketPath << std::endl;
+        return 2;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    if (connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address))) {
+        std::cerr << "ERROR:\tCannot connect to " << socketPath << ": " << std::strerror(errno) << std::endl
+                  << "Start a server with: mila --server=" << socketPath << std::endl;
+        return 2;
+    }
+
+    bool sent = send_message(connection, directory) &&
+                send_message(connection, std::to_string(arguments.size()));
+    for (const auto& arg : arguments)
+        sent = sent && send_message(connection, arg);
+    sent = sent && send_message(connection, source);
+
+    std::string status, out, err;
+    if (!sent || !receive_message(connection, status) || !receive_message(connection, out) ||
+        !receive_message(connection, err)) {
+        // Most likely it crashed on one of LLVM's own threads, which takes the whole process down
+        std::cerr << "ERROR:\tThe server at " << socketPath << " closed the connection, it may have crashed "
+                  << "(see its output) and has to be started again" << std::endl;
+        return 2;
+    }
+    close(connection);
+    std::cout << out;
+    std::cerr << err;
+    return std::stoi(status);
+}
@@ -0,0 +1,52 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_BATCH_H
+#define BIE_PJP_MILALANGUAGECOMPILER_BATCH_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Compiles many programs in one process, several at a time
+//
+// Every file is an independent job with its own Driver, and so its own
+// parser, code generator and LLVMContext. Jobs are queued on a thread pool
+// which idle threads take the next one from, so one slow file does not hold
+// up the others. Results come out as JSON.
+class Batch {
+public:
+    struct Job {
+        std::string source;
+        std::string output;
+        int status = 0;
+        double time = 0;            // ms
+        std::string diagnostics;    // what the compiler printed to stderr
+    };
+
+    // Options are passed to every job as they are
+    Batch(std::vector<std::string> options, unsigned threads);
+
+    void add(const std::string& source, const std::string& output);
+    // One job per line, the source and optionally the output, separated by whitespace
+    void add_manifest(const std::string& file);
+    // Returns the number of jobs that failed
+    unsigned run();
+    void write_summary(std::ostream& stream) const;
+
+    const std::vector<Job>& jobs() const { return m_jobs; }
+    double time() const { return m_time; }
+
+private:
+    void compile(Job& job);
+
+    std::vector<std::string> m_options;
+    unsigned m_threads;
+    std::vector<Job> m_jobs;
+    double m_time = 0;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_BATCH_H
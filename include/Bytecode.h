@@ -0,0 +1,109 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_BYTECODE_H
+#define BIE_PJP_MILALANGUAGECOMPILER_BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Register machine: a, b, c are registers of the current frame unless noted otherwise,
+// value is an immediate, a constant/string/global index or a jump target
+enum Opcode : uint16_t {
+    OP_MOVE,                // a = b
+    OP_LOAD_INT,            // a = value
+    OP_LOAD_CONST,          // a = constants[value]
+    OP_LOAD_GLOBAL,         // a = globals[value]
+    OP_STORE_GLOBAL,        // globals[value] = a
+
+    OP_ADD,                 // a = b + c
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_INC,                 // a = a + 1
+    OP_DEC,
+    OP_NEG,                 // a = -b
+    OP_NOT,                 // a = ~b
+    OP_NOT_BOOLEAN,         // a = !b
+    OP_AND,                 // a = b & c
+    OP_OR,
+    OP_EQ,                  // a = b == c
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+
+    OP_FADD,                // same for doubles
+    OP_FSUB,
+    OP_FMUL,
+    OP_FDIV,
+    OP_FMOD,
+    OP_FNEG,
+    OP_FEQ,
+    OP_FNE,
+    OP_FLT,
+    OP_FLE,
+    OP_FGT,
+    OP_FGE,
+    OP_TO_DOUBLE,           // a = (double) b
+
+    OP_JUMP,                // goto value
+    OP_JUMP_IF_ZERO,        // if (!a) goto value
+    OP_JUMP_IF_NOT_ZERO,
+    OP_JUMP_IF_EQ,          // if (a == b) goto value
+    OP_JUMP_IF_NE,
+    OP_JUMP_IF_LT,
+    OP_JUMP_IF_LE,
+    OP_JUMP_IF_GT,
+    OP_JUMP_IF_GE,
+
+    OP_CALL,                // a = functions[b](c, c + 1, ...)
+    OP_TAIL_CALL,           // return functions[b](c, c + 1, ...), reusing the frame
+    OP_RETURN,              // return a
+    OP_RETURN_VOID,
+
+    OP_WRITE_INT,
+    OP_WRITELN_INT,
+    OP_WRITE_DOUBLE,
+    OP_WRITELN_DOUBLE,
+    OP_WRITE_STRING,        // strings[value]
+    OP_READ_INT,
+    OP_READ_DOUBLE,
+
+    OP_COUNT
+};
+
+struct Instruction {
+    Opcode op;
+    uint16_t a, b, c;
+    int32_t value;
+};
+
+union Value {
+    int32_t i;
+    double d;
+};
+
+struct BytecodeFunction {
+    std::string name;
+    uint16_t arguments = 0;         // passed in the first registers
+    uint16_t registers = 0;
+    bool defined = false;
+    std::vector<Instruction> code;
+};
+
+struct BytecodeProgram {
+    std::vector<BytecodeFunction> functions;
+    uint16_t main = 0;
+    std::vector<Value> globals;     // initial values
+    std::vector<Value> constants;
+    std::vector<std::string> strings;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_BYTECODE_H
@@ -0,0 +1,93 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_BYTECODECOMPILER_H
+#define BIE_PJP_MILALANGUAGECOMPILER_BYTECODECOMPILER_H
+
+#include "Bytecode.h"
+#include "Expression.h"
+
+#include <map>
+#include <set>
+
+
+enum ValueType {
+    VALUE_VOID,
+    VALUE_BOOLEAN,
+    VALUE_INTEGER,
+    VALUE_DOUBLE,
+    VALUE_STRING
+};
+
+// Result of an expression: the register holding it and its type
+struct Operand {
+    uint16_t reg;
+    ValueType type;
+};
+
+// Lowers the syntax tree to bytecode for the VM, a back end with no LLVM in the way
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(std::shared_ptr<TopLevelExpression> tree) : m_tree(std::move(tree)) {}
+    BytecodeProgram compile();
+
+private:
+    struct Prototype {
+        std::vector<ValueType> arguments;
+        ValueType result;
+    };
+    struct Local {
+        uint16_t reg;
+        ValueType type;
+    };
+
+    void declare_function(const std::shared_ptr<FunctionExpression> expr);
+    void compile_function(const std::shared_ptr<FunctionExpression> expr);
+    void compile_main();
+    void finish_function(const Local* result);
+
+    void compile_statement(const ExpressionPointer expr);
+    void compile_assign(const std::shared_ptr<AssignExpression> expr);
+    void compile_condition(const std::shared_ptr<ConditionExpression> expr);
+    void compile_case(const std::shared_ptr<CaseExpression> expr);
+    void compile_while(const std::shared_ptr<WhileLoopExpression> expr);
+    void compile_for(const std::shared_ptr<ForLoopExpression> expr);
+    size_t compile_branch(const ExpressionPointer condition, bool jumpIf);
+
+    Operand compile_expression(const ExpressionPointer expr, int target = -1);
+    Operand compile_identifier(const std::string& name, TextPosition position, int target);
+    Operand compile_binary_operation(const std::shared_ptr<BinaryOperationExpression> expr, int target);
+    Operand compile_unary_operation(const std::shared_ptr<UnaryOperationExpression> expr, int target);
+    Operand compile_logical(const std::shared_ptr<BinaryOperationExpression> expr, int target);
+    Operand compile_call(const std::shared_ptr<CallExpression> expr, int target);
+    Operand compile_write(const std::shared_ptr<CallExpression> expr, bool newline);
+    Operand compile_read(const std::shared_ptr<CallExpression> expr);
+
+    void assign(const std::string& name, const ExpressionPointer value, TextPosition position);
+    bool fold(const ExpressionPointer expr, Value& value, ValueType& type);
+    Value constant(const ExpressionPointer expr, ValueType& type);
+    Operand to_double(Operand operand);
+
+    uint16_t new_register();
+    size_t emit(Opcode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0, int32_t value = 0);
+    void patch(size_t jump) { m_code->code[jump].value = here(); }
+    int32_t here() const { return static_cast<int32_t>(m_code->code.size()); }
+
+    std::shared_ptr<TopLevelExpression> m_tree;
+    BytecodeProgram m_program;
+    std::vector<Prototype> m_prototypes;                // parallel to m_program.functions
+    std::map<std::string, uint16_t> m_functions;
+    std::map<std::string, std::pair<Value, ValueType>> m_constants;
+    std::map<std::string, Local> m_globals;             // reg is the global index
+    std::map<std::string, Local> m_locals;
+    std::set<std::string> m_loopCounters;
+
+    BytecodeFunction* m_code = nullptr;                 // being compiled
+    uint16_t m_nextRegister = 0;
+    std::vector<size_t>* m_breaks = nullptr;            // jumps out of the innermost loop
+    std::vector<size_t> m_exits;                        // jumps to the epilogue
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_BYTECODECOMPILER_H
@@ -6,6 +6,7 @@
 #define BIE_PJP_MILALANGUAGECOMPILER_CODEGENERATOR_H
 
 #include "Expression.h"
+#include "Options.h"
 
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/STLExtras.h"
@@ -18,22 +19,58 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <set>
 
 class CodeGenerator {
 public:
-    CodeGenerator(std::shared_ptr<TopLevelExpression> tree) :
+    CodeGenerator(std::shared_ptr<TopLevelExpression> tree, Options options = Options()) :
+            m_threadSafeContext(std::make_unique<llvm::LLVMContext>()),
+            m_context(*m_threadSafeContext.getContext()),
             m_builder(std::make_shared<llvm::IRBuilder<>>(m_context)),
             m_module(std::make_unique<llvm::Module>("jit", m_context)),
-            m_tree(std::move(tree)) {
+            m_tree(std::move(tree)),
+            m_options(std::move(options)) {
         add_standard_functions();
     }
     llvm::Value *generate(const ExpressionPointer expr, llvm::BasicBlock *breakTo, llvm::BasicBlock *exitTo);
     llvm::Value* generate_code();
-    void write_output(const char* fileName);
-    void print() const;
+    // For lazy compilation: main with the other functions only declared, or a single function
+    llvm::Value* generate_main();
+    llvm::Value* generate_function(const std::string& name);
+    // A unit: no main, private helpers, only the interface exported
+    llvm::Value* generate_unit();
+    void optimize();
+    // Links in the objects of used units too
+    void write_output(const char* fileName, const std::vector<std::string>& units = {});
+    // Only compiles, for linking later
+    void write_object(const std::string& fileName);
+    // Same, into memory
+    void emit_object(llvm::SmallVectorImpl<char>& object);
+    void print(llvm::raw_ostream& stream = llvm::errs()) const;
+    llvm::Module* module() const { return m_module.get(); }
+    // Hands the module over, e.g. to the JIT
+    llvm::orc::ThreadSafeModule take_module();
+    const std::list<std::pair<TextPosition, std::string>>& warnings() const { return m_warnings; }
+    // Registers the host target, done on first use otherwise
+    static void initialize_targets();
 
 private:
     void add_standard_functions();
+    void link_runtime();
+    void declare_globals(bool define);
+    llvm::Function* declare_function(const std::shared_ptr<FunctionExpression> expr);
+    llvm::Value* gen_main();
+    llvm::TargetMachine* target_machine();
+    std::unique_ptr<llvm::TargetMachine> create_target_machine() const;
+    size_t partitions() const;
+    static void write_file(const std::string& fileName, llvm::ArrayRef<char> contents);
+    std::string target_cpu() const;
+    std::string target_features() const;
+    void multiversion();
+    void internalize();
 
     llvm::Value *gen_block(const std::shared_ptr<BlockExpression> expr, llvm::BasicBlock *breakTo,
                            llvm::BasicBlock *exitTo);
@@ -41,34 +78,70 @@ private:
     llvm::Value* gen_double(const std::shared_ptr<DoubleExpression> expr);
     llvm::Value* gen_identifier(const std::shared_ptr<IdentifierExpression> expr);
     llvm::Value* gen_binary_operation(const std::shared_ptr<BinaryOperationExpression> expr);
+    llvm::Value* gen_unary_operation(const std::shared_ptr<UnaryOperationExpression> expr);
+    llvm::Value* gen_logical(const std::shared_ptr<BinaryOperationExpression> expr);
     llvm::Value* gen_call(const std::shared_ptr<CallExpression> expr);
     llvm::Value* gen_function(const std::shared_ptr<FunctionExpression> expr);
     llvm::Value* gen_condition(const std::shared_ptr<ConditionExpression> expr, llvm::BasicBlock *breakTo,
                                llvm::BasicBlock *exitTo);
+    llvm::Value* gen_case(const std::shared_ptr<CaseExpression> expr, llvm::BasicBlock *breakTo,
+                          llvm::BasicBlock *exitTo);
     llvm::Value* gen_assign(const std::shared_ptr<AssignExpression> expr);
     llvm::Value* gen_while(const std::shared_ptr<WhileLoopExpression> expr, llvm::BasicBlock *exitTo);
     llvm::Value* gen_break(llvm::BasicBlock *breakTo, TextPosition position);
     llvm::Value* gen_for(const std::shared_ptr<ForLoopExpression> expr, llvm::BasicBlock *exitTo);
     llvm::Value* gen_exit(llvm::BasicBlock* exitTo, TextPosition position);
+    llvm::Value* gen_tail_call(const std::shared_ptr<CallExpression> expr);
     llvm::Value* gen_parentheses(const std::shared_ptr<ParenthesesExpression> expr);
     llvm::Value *gen_string(const std::shared_ptr<StringExpression> expr, bool newline=false);
 
     llvm::Value *gen_binary_ints(llvm::Value *left, llvm::Value *right, TokenType type, const TextPosition position);
     llvm::Value *gen_binary_doubles(llvm::Value *left, llvm::Value *right, TokenType type, const TextPosition position);
 
+    void collect_tail_calls(const ExpressionPointer expr, bool tail);
+    void continue_unreachable();
+    void warning(TextPosition position, std::string message);
+
+    void collect_read_targets(const ExpressionPointer expr, std::set<std::string>& names);
+
+    // SSA construction for local scalars
+    void write_variable(const std::string& name, llvm::BasicBlock* block, llvm::Value* value);
+    llvm::Value* read_variable(const std::string& name, llvm::BasicBlock* block);
+    llvm::Value* read_variable_recursive(const std::string& name, llvm::BasicBlock* block);
+    llvm::PHINode* create_phi(const std::string& name, llvm::BasicBlock* block);
+    llvm::Value* add_phi_operands(const std::string& name, llvm::PHINode* phi);
+    llvm::Value* try_remove_trivial_phi(llvm::PHINode* phi);
+    void seal_block(llvm::BasicBlock* block);
+
     llvm::Value* assign(std::string name, llvm::Value *value, TextPosition position);
     llvm::Value* load(const std::string &name, TextPosition position);
     llvm::Type* get_type(TokenType type);
     llvm::Constant* get_default_value(TokenType type);
     llvm::AllocaInst* create_alloca(llvm::Function* function, const std::string& name, llvm::Type *type);
+    llvm::MDNode* create_loop_id();
+    llvm::ConstantInt* case_label(const ExpressionPointer expr);
 
-    llvm::LLVMContext m_context;
+    llvm::orc::ThreadSafeContext m_threadSafeContext;
+    llvm::LLVMContext& m_context;
     std::shared_ptr<llvm::IRBuilder<>> m_builder;
     std::unique_ptr<llvm::Module> m_module;
     std::map<std::string, llvm::AllocaInst *> m_variables;
     std::map<std::string, llvm::Constant *> m_constants;
     std::map<std::string, llvm::GlobalVariable*> m_globals;
+    std::set<std::string> m_loopCounters;
+    std::map<std::string, llvm::Type*> m_ssaVariables;
+    std::map<llvm::BasicBlock*, std::map<std::string, llvm::Value*>> m_currentDef;
+    std::map<llvm::BasicBlock*, std::map<std::string, llvm::PHINode*>> m_incompletePhis;
+    std::set<llvm::BasicBlock*> m_sealedBlocks;
+    std::shared_ptr<FunctionExpression> m_function;     // being generated
+    std::set<const Expression*> m_tailCalls;
+    llvm::BasicBlock* m_tailCallBlock = nullptr;
+    // Start out zero on every call, including the ones turned into a jump
+    std::vector<std::pair<std::string, llvm::Type*>> m_locals;
+    std::list<std::pair<TextPosition, std::string>> m_warnings;
     std::shared_ptr<TopLevelExpression> m_tree;
+    Options m_options;
+    std::unique_ptr<llvm::TargetMachine> m_targetMachine;
 };
 
 
@@ -0,0 +1,89 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_COMPILATION_H
+#define BIE_PJP_MILALANGUAGECOMPILER_COMPILATION_H
+
+#include "Expression.h"
+#include "Options.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Module.h"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CodeGenerator;
+
+
+// The compiler as a library, from source in memory to a tree, a module or an object
+//
+// A compilation owns all it works with, down to its own LLVMContext, so any
+// number of them can run on different threads at once. Nothing is printed
+// and no exception gets out, problems end up in diagnostics(). Each step runs
+// the ones before it first and returns false once there is an error:
+//
+//     Compilation compilation(source, options);
+//     if (!compilation.emit())
+//         for (const auto& diagnostic : compilation.diagnostics())
+//             log(diagnostic.to_string());
+//     link(compilation.object());
+//
+// Units a program uses are compiled or reused from options.unitDirectories,
+// their objects have to be linked with the program's.
+class Compilation {
+public:
+    struct Diagnostic {
+        bool error;                 // a warning otherwise
+        TextPosition position;      // line 0 if it has none
+        std::string message;
+
+        // "line:column: error: message"
+        std::string to_string() const;
+    };
+
+    explicit Compilation(std::string source, Options options = Options());
+    ~Compilation();
+
+    bool parse();
+    // Optimized as the options say
+    bool generate();
+    bool emit();
+
+    const std::list<Diagnostic>& diagnostics() const { return m_diagnostics; }
+    bool failed() const { return m_failed; }
+
+    // With the interfaces of used units merged in, null until parsed
+    std::shared_ptr<TopLevelExpression> tree() const { return m_tree; }
+    // Null until generated and after it is taken
+    llvm::Module* module() const;
+    // E.g. for a JIT; emit() cannot be used afterwards
+    llvm::orc::ThreadSafeModule take_module();
+    llvm::ArrayRef<char> object() const { return m_object; }
+    const std::vector<std::string>& unit_objects() const { return m_unitObjects; }
+
+private:
+    // Runs the step unless an earlier one failed, turning exceptions into diagnostics
+    template<typename Step>
+    bool attempt(Step step);
+    void warn(const std::list<std::pair<TextPosition, std::string>>& warnings);
+
+    std::string m_source;
+    Options m_options;
+    std::shared_ptr<TopLevelExpression> m_tree;
+    std::unique_ptr<CodeGenerator> m_generator;
+    bool m_moduleTaken = false;
+    llvm::SmallVector<char, 0> m_object;
+    bool m_emitted = false;
+    std::vector<std::string> m_unitObjects;
+    std::list<Diagnostic> m_diagnostics;
+    bool m_failed = false;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_COMPILATION_H
@@ -0,0 +1,46 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_DRIVER_H
+#define BIE_PJP_MILALANGUAGECOMPILER_DRIVER_H
+
+#include "TextPosition.h"
+
+#include <istream>
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// One compiler invocation, from the command line arguments to the exit status
+//
+// Everything it prints goes to the given streams, so the server can hand the
+// output of a request back to its client.
+class Driver {
+public:
+    Driver(std::string program, std::ostream& out, std::ostream& err);
+
+    // Arguments without the program name, the source is read from the named file
+    int run(const std::vector<std::string>& args);
+    // Same, with the source already in memory
+    int run(const std::vector<std::string>& args, const std::string& source);
+    // The IR of an executable goes to err unless turned off
+    void print_ir(bool print) { m_printIR = print; }
+
+private:
+    int compile(const std::vector<std::string>& args, const std::string* source);
+    void usage();
+    // Shows the offending source line with a marker under the given column
+    void print_position(std::istream& file, TextPosition pos);
+    void print_warnings(std::istream& file, const std::list<std::pair<TextPosition, std::string>>& warnings);
+
+    std::string m_program;
+    std::ostream& m_out;
+    std::ostream& m_err;
+    bool m_printIR = true;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_DRIVER_H
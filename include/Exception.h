@@ -18,6 +18,7 @@ public:
 
     Exception(std::string mess) :
         m_position({0, 0}),
+        m_message(std::move(mess)),
         m_hasPosition(false) {}
 
     TextPosition position() const { return std::move(m_position); }
@@ -9,6 +9,7 @@
 #include "Token.h"
 
 #include <memory>
+#include <set>
 #include <sstream>
 #include <string>
 #include <list>
@@ -21,6 +22,7 @@ enum ExpressionType {
     EXPR_BLOCK,
     EXPR_BREAK,
     EXPR_CALL,
+    EXPR_CASE,
     EXPR_CONDITION,
     EXPR_CONST,
     EXPR_DOUBLE,
@@ -32,6 +34,7 @@ enum ExpressionType {
     EXPR_PARENTHESES,
     EXPR_STRING,
     EXPR_TOP_LEVEL,
+    EXPR_UNARY_OPERATION,
     EXPR_VAR,
     EXPR_WHILE_LOOP
 };
@@ -49,6 +52,8 @@ public:
 
     virtual bool can_be_operand() const = 0;
     virtual bool can_be_argument() const { return can_be_operand(); }
+    // Cheap to evaluate, without side effects and unable to trap
+    virtual bool can_be_speculated() const { return false; }
     virtual ExpressionType type() const = 0;
 
 protected:
@@ -114,6 +119,7 @@ public:
     IntegerExpression(const int value, const TextPosition tp) : Expression(std::move(tp)), m_value(value) {}
 
     bool can_be_operand() const override { return true; }
+    bool can_be_speculated() const override { return true; }
     ExpressionType type() const override { return EXPR_INTEGER; }
     int value() const { return m_value; }
 
@@ -129,6 +135,7 @@ public:
     DoubleExpression(const double value, const TextPosition tp) : Expression(std::move(tp)), m_value(value) {}
 
     bool can_be_operand() const override { return true; }
+    bool can_be_speculated() const override { return true; }
     ExpressionType type() const override { return EXPR_DOUBLE; }
 
     std::string to_string() const override;
@@ -147,6 +154,7 @@ public:
             m_value(std::move(name)) {}
 
     bool can_be_operand() const override { return true; }
+    bool can_be_speculated() const override { return true; }
     ExpressionType type() const override { return EXPR_IDENTIFIER; }
     std::string value() const { return m_value; }
 
@@ -225,6 +233,7 @@ public:
 
     bool can_be_operand() const override { return true; }
     bool is_boolean() const override { return m_expression->is_boolean(); }
+    bool can_be_speculated() const override { return m_expression->can_be_speculated(); }
     ExpressionType type() const override { return EXPR_PARENTHESES; }
 
     std::string to_string() const override;
@@ -248,6 +257,13 @@ public:
 
     bool can_be_operand() const override { return true; }
     bool is_boolean() const override { return m_isBoolean; }
+    bool can_be_speculated() const override {
+        // division by zero traps
+        auto opType = m_operator->type();
+        if (opType == TOK_DIV || opType == TOK_DIVIDE || opType == TOK_MOD)
+            return false;
+        return m_left->can_be_speculated() && m_right->can_be_speculated();
+    }
     ExpressionType type() const override { return EXPR_BINARY_OPERATION; }
     std::shared_ptr<OperatorToken> op() const { return m_operator; }
     ExpressionPointer left() const { return m_left; }
@@ -263,6 +279,29 @@ private:
 };
 
 
+// -x, not x
+class UnaryOperationExpression : public Expression {
+public:
+    UnaryOperationExpression(const TokenType op, const ExpressionPointer operand, const TextPosition tp) :
+            Expression(std::move(tp)),
+            m_operator(op),
+            m_operand(std::move(operand)) {}
+
+    bool can_be_operand() const override { return true; }
+    bool is_boolean() const override { return m_operator == TOK_NOT && m_operand->is_boolean(); }
+    bool can_be_speculated() const override { return m_operand->can_be_speculated(); }
+    ExpressionType type() const override { return EXPR_UNARY_OPERATION; }
+    TokenType op() const { return m_operator; }
+    ExpressionPointer operand() const { return m_operand; }
+
+    std::string to_string() const override;
+
+private:
+    const TokenType m_operator;
+    const ExpressionPointer m_operand;
+};
+
+
 class FunctionExpression : public Expression {
 public:
     FunctionExpression(const std::string name, TokenType type, const std::list<Variable> args,
@@ -328,12 +367,16 @@ public:
                        const std::shared_ptr<ConstExpression> consts,
                        const std::shared_ptr<VarExpression> vars,
                        const std::shared_ptr<BlockExpression> body,
-                       const TextPosition tp) :
+                       const TextPosition tp,
+                       const std::list<std::string> uses = {},
+                       const std::list<Variable> externals = {}) :
             Expression(std::move(tp)),
             m_functions(std::move(functions)),
             m_consts(std::move(consts)),
             m_vars(std::move(vars)),
-            m_body(std::move(body)) {}
+            m_body(std::move(body)),
+            m_uses(std::move(uses)),
+            m_externals(std::move(externals)) {}
 
     bool can_be_operand() const override { return false; }
     ExpressionType type() const override { return EXPR_TOP_LEVEL; }
@@ -360,11 +403,47 @@ public:
         return std::move(m_functions);
     }
 
+    // Units named in the uses clause
+    const std::list<std::string>& uses() const { return m_uses; }
+    // Variables of used units, defined in their objects
+    const std::list<Variable>& externals() const { return m_externals; }
+
 private:
     std::list<std::shared_ptr<FunctionExpression>> m_functions;
     std::shared_ptr<ConstExpression> m_consts;
     std::shared_ptr<VarExpression> m_vars;
     std::shared_ptr<BlockExpression> m_body;
+    std::list<std::string> m_uses;
+    std::list<Variable> m_externals;
+};
+
+
+// unit ... interface ... implementation ... end.
+// Has no body, only what is declared in the interface is visible to other units.
+class UnitExpression : public TopLevelExpression {
+public:
+    UnitExpression(const std::string name, const std::set<std::string> exports,
+                   const std::list<std::shared_ptr<FunctionExpression>> functions,
+                   const std::shared_ptr<ConstExpression> consts,
+                   const std::shared_ptr<VarExpression> vars,
+                   const TextPosition tp,
+                   const std::list<std::string> uses = {},
+                   const std::list<Variable> externals = {}) :
+            TopLevelExpression(std::move(functions), std::move(consts), std::move(vars), nullptr, std::move(tp),
+                               std::move(uses), std::move(externals)),
+            m_name(std::move(name)),
+            m_exports(std::move(exports)) {}
+
+    std::string name() const { return m_name; }
+    const std::set<std::string>& exports() const { return m_exports; }
+
+    std::string to_string() const override;
+    // The interface alone, what units and programs using this one are compiled against
+    std::string summary() const;
+
+private:
+    const std::string m_name;
+    const std::set<std::string> m_exports;
 };
 
 
@@ -395,6 +474,40 @@ private:
 };
 
 
+// Single value (second is nullptr) or an inclusive range of values
+typedef std::pair<ExpressionPointer, ExpressionPointer> CaseLabel;
+
+struct CaseBranch {
+    std::list<CaseLabel> labels;
+    ExpressionPointer body;
+};
+
+// case ... of ... end
+class CaseExpression : public Expression {
+public:
+    CaseExpression(const ExpressionPointer selector, const std::list<CaseBranch> branches,
+                   const ExpressionPointer otherwise, const TextPosition tp) :
+            Expression(std::move(tp)),
+            m_selector(std::move(selector)),
+            m_branches(std::move(branches)),
+            m_otherwise(std::move(otherwise)) {}
+
+    bool can_be_operand() const override { return false; }
+    ExpressionType type() const override { return EXPR_CASE; }
+
+    ExpressionPointer selector() const { return m_selector; }
+    const std::list<CaseBranch>& branches() const { return m_branches; }
+    ExpressionPointer otherwise() const { return m_otherwise; }
+
+    std::string to_string() const override;
+
+private:
+    const ExpressionPointer m_selector;
+    const std::list<CaseBranch> m_branches;
+    const ExpressionPointer m_otherwise;
+};
+
+
 class WhileLoopExpression : public Expression {
 public:
     WhileLoopExpression(const ExpressionPointer cond, const ExpressionPointer body, const TextPosition tp) :
@@ -0,0 +1,49 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_INCREMENTALBUILD_H
+#define BIE_PJP_MILALANGUAGECOMPILER_INCREMENTALBUILD_H
+
+#include "Expression.h"
+#include "Options.h"
+
+#include <list>
+#include <map>
+#include <set>
+
+
+// Builds an executable out of one object per function, compiling only what changed
+//
+// Each function is hashed from its text and the declarations it uses: global
+// vars and consts and the signatures of its callees. Objects are kept in a
+// directory under that hash, so an unchanged function is just linked again.
+class IncrementalBuild {
+public:
+    IncrementalBuild(std::shared_ptr<TopLevelExpression> tree, Options options, std::string directory);
+    void build(const std::string& output, const std::vector<std::string>& units = {});
+
+    unsigned compiled() const { return m_compiled; }
+    unsigned total() const { return m_total; }
+    const std::list<std::pair<TextPosition, std::string>>& warnings() const { return m_warnings; }
+
+private:
+    std::string function_hash(const std::shared_ptr<FunctionExpression>& function);
+    std::string main_hash();
+    void collect_names(const ExpressionPointer& expr, std::set<std::string>& names);
+    std::string object(const std::string& hash) const;
+    // Compiles into a temporary file first, an interrupted build leaves no broken object behind
+    template<typename Generate>
+    void compile(const std::string& hash, Generate generate);
+
+    std::shared_ptr<TopLevelExpression> m_tree;
+    Options m_options;
+    std::string m_directory;
+    std::map<std::string, std::string> m_declarations;  // globals and function signatures by name
+    unsigned m_compiled = 0;
+    unsigned m_total = 0;
+    std::list<std::pair<TextPosition, std::string>> m_warnings;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_INCREMENTALBUILD_H
@@ -0,0 +1,94 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_JIT_H
+#define BIE_PJP_MILALANGUAGECOMPILER_JIT_H
+
+#include "Options.h"
+
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Compiles a module in memory and runs its main
+//
+// In tiered mode every function is first compiled as is, with a call counter
+// in its prologue, and all calls go through a per-function pointer. Once a
+// function gets hot it is recompiled at -O3 on a background thread and its
+// pointer is swapped to the new code.
+//
+// In lazy mode only main is compiled up front, every other function is
+// generated and compiled by the factory on its first call. If that fails the
+// call cannot return, so it is a fatal LLVM error.
+class JIT {
+public:
+    typedef std::function<llvm::orc::ThreadSafeModule(const std::string& function)> ModuleFactory;
+
+    JIT(Options options);
+    ~JIT();
+    int run(llvm::orc::ThreadSafeModule module);
+    int run_lazy(llvm::orc::ThreadSafeModule main, const std::vector<std::string>& functions,
+                 ModuleFactory factory);
+    // A bare session for the host, with the process's symbols visible to the code
+    static std::unique_ptr<llvm::orc::LLJIT> create_session(const Options& options);
+    // Compiled units linked in before running
+    void add_objects(const std::vector<std::string>& objects) { m_objects = objects; }
+
+    // Milliseconds spent by the last run()
+    double compile_time() const { return m_compileTime; }
+    double execution_time() const { return m_executionTime; }
+    // Functions swapped to optimized code by the last run()
+    unsigned recompiled() const { return m_recompiled; }
+    // Why functions kept their first code in the last run()
+    const std::vector<std::string>& warnings() const { return m_warnings; }
+    // Functions compiled on demand by the last run_lazy()
+    unsigned lazily_compiled() const { return m_lazilyCompiled; }
+
+private:
+    // The CPU, features and code generation level the options ask for
+    static llvm::orc::JITTargetMachineBuilder target_builder(const Options& options);
+    std::unique_ptr<llvm::orc::LLJIT> create_jit();
+    int execute(llvm::JITEvaluatedSymbol main, std::chrono::steady_clock::time_point start);
+
+    void prepare_tiers(llvm::Module& module);
+    void route_calls(llvm::Function* callee, llvm::GlobalVariable* pointer);
+    void count_calls(llvm::Function* function, unsigned index);
+    static void tier_up(JIT* jit, unsigned index);
+    void recompile(unsigned index);
+    void background();
+    void stop_background();
+
+    Options m_options;
+    std::vector<std::string> m_objects;
+    double m_compileTime = 0;
+    double m_executionTime = 0;
+
+    std::unique_ptr<llvm::orc::LLJIT> m_jit;
+    std::unique_ptr<llvm::orc::LazyCallThroughManager> m_callThrough;
+    std::unique_ptr<llvm::orc::IndirectStubsManager> m_stubs;
+    std::atomic<unsigned> m_lazilyCompiled{0};
+    std::string m_bitcode;                  // module before instrumentation
+    std::vector<std::string> m_functions;   // tiered functions by index
+    unsigned m_recompiled = 0;
+    std::vector<std::string> m_warnings;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::deque<unsigned> m_hot;
+    bool m_stopping = false;
+    std::thread m_background;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_JIT_H
@@ -0,0 +1,75 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_KERNEL_H
+#define BIE_PJP_MILALANGUAGECOMPILER_KERNEL_H
+
+#include "Expression.h"
+#include "Options.h"
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Mila functions compiled in memory into native code the host calls directly
+//
+//     Kernel kernel("program k;\n"
+//                   "function scale(x : double) : double;\n"
+//                   "begin scale := x * 2.5; end;\n"
+//                   "begin end.", options);
+//     auto scale = kernel.function<double(double)>("scale");
+//     double y = scale(4);
+//
+// The pointer is the compiled function itself, a call costs what any native
+// call does. It stays valid as long as the kernel. Mila's integer is int,
+// double is double and a procedure returns void; the signature is checked
+// when the function is looked up. The main block is never run, global vars
+// start out zero. Errors in the source throw an Exception.
+//
+// write and writeln go to the output callbacks when set, printf otherwise.
+// The callbacks are compiled into the code as constants, so they cost a
+// plain call too.
+class Kernel {
+public:
+    struct Output {
+        void* context = nullptr;    // passed to every callback
+        void (*integer)(void* context, int value, bool newline) = nullptr;
+        void (*real)(void* context, double value, bool newline) = nullptr;
+        void (*text)(void* context, const char* text) = nullptr;    // a writeln's ends with '\n'
+    };
+
+    explicit Kernel(const std::string& source, Options options = Options());
+    Kernel(const std::string& source, Options options, Output output);
+
+    template<typename Signature>
+    Signature* function(const std::string& name) {
+        return reinterpret_cast<Signature*>(address(name, Types<Signature>::result(), Types<Signature>::args()));
+    }
+
+private:
+    template<typename T> struct Type;
+    template<typename Signature> struct Types;
+
+    void* address(const std::string& name, TokenType result, const std::vector<TokenType>& args);
+    void redirect_output(llvm::Module& module, const Output& output);
+
+    std::shared_ptr<TopLevelExpression> m_tree;
+    std::unique_ptr<llvm::orc::LLJIT> m_jit;
+};
+
+template<> struct Kernel::Type<int> { static TokenType get() { return TOK_INTEGER; } };
+template<> struct Kernel::Type<double> { static TokenType get() { return TOK_DOUBLE; } };
+template<> struct Kernel::Type<void> { static TokenType get() { return TOK_VOID; } };
+
+template<typename Result, typename... Args>
+struct Kernel::Types<Result(Args...)> {
+    static TokenType result() { return Type<Result>::get(); }
+    static std::vector<TokenType> args() { return {Type<Args>::get()...}; }
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_KERNEL_H
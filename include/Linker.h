@@ -0,0 +1,38 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_LINKER_H
+#define BIE_PJP_MILALANGUAGECOMPILER_LINKER_H
+
+#include "llvm/ADT/Triple.h"
+
+#include <string>
+#include <vector>
+
+
+// Links object files against the C library into an executable
+//
+// Does the job of the compiler driver: finds the C runtime start files and
+// passes them to the linker. With MILA_HAS_LLD the linker is lld running in
+// this process and nothing is spawned. Otherwise ld.lld or ld is started
+// directly, without a shell. Either way the objects are read from files, lld
+// has no way to take them from memory.
+class Linker {
+public:
+    Linker(const llvm::Triple& triple);
+    void link(const std::vector<std::string>& objects, const std::string& output);
+
+private:
+    std::vector<std::string> arguments(const std::vector<std::string>& objects, const std::string& output);
+    std::string find_file(const std::vector<std::string>& directories, const std::string& name);
+    std::string gcc_directory();
+
+    llvm::Triple m_triple;
+    std::string m_emulation;        // -m of the linker
+    std::string m_dynamicLinker;
+    std::vector<std::string> m_libraryDirectories;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_LINKER_H
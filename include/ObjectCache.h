@@ -0,0 +1,53 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_OBJECTCACHE_H
+#define BIE_PJP_MILALANGUAGECOMPILER_OBJECTCACHE_H
+
+#include "Options.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+
+// On-disk cache of linked executables keyed by everything that affects the code
+//
+// Entries are written to a temporary file and renamed into place, so readers
+// never see a partial one. When the cache grows over its limit the least
+// recently used entries go first. Several compilers may share a directory.
+//
+// Only the executable is kept, a hit prints none of the warnings the
+// compilation that stored it did.
+class ObjectCache {
+public:
+    struct Statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t entries = 0;
+        uint64_t size = 0;      // bytes
+    };
+
+    ObjectCache(std::string directory, uint64_t maxSize);
+    static std::string default_directory();
+
+    // Hash of the source, the compiler and the code generation options
+    static std::string key(const std::string& source, const Options& options);
+    // Copies the entry to output if there is one, counts a hit or a miss
+    bool fetch(const std::string& key, const std::string& output);
+    void store(const std::string& key, const std::string& file);
+    Statistics statistics();
+
+private:
+    std::string entry(const std::string& key) const;
+    void locked(const std::function<void()>& action);
+    void count(bool hit);
+    void evict();
+
+    std::string m_directory;
+    uint64_t m_maxSize;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_OBJECTCACHE_H
@@ -0,0 +1,124 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_OPTIONS_H
+#define BIE_PJP_MILALANGUAGECOMPILER_OPTIONS_H
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum OptLevel {
+    OPT_0,
+    OPT_1,
+    OPT_2,
+    OPT_3,
+    OPT_SIZE,       // -Os
+    OPT_MIN_SIZE    // -Oz
+};
+
+// Settings shared by the command line and the code generator
+struct Options {
+    OptLevel optLevel = OPT_0;
+    std::string cpu = "generic";    // or "native"
+    std::string features;           // "+avx2,-fma"
+    std::string multiversion;       // "auto" or comma separated function names
+    bool wholeProgram = false;      // nothing outside the module uses it except for main
+    bool ssa = false;               // keep local scalars in SSA registers instead of allocas
+    bool run = false;               // JIT compile and execute instead of writing an executable
+    bool tiered = false;            // with run: recompile hot functions at -O3 in the background
+    unsigned tierThreshold = 1000;  // calls before a function counts as hot
+    bool lazy = false;              // with run: generate and compile each function on its first call
+    bool vm = false;                // interpret bytecode, no LLVM involved
+    unsigned jobs = 1;              // threads for machine code generation
+    bool cache = false;             // reuse executables built from the same source and options
+    std::string cacheDir;           // empty for the default one
+    unsigned cacheSize = 256;       // MiB
+    bool incremental = false;       // one object per function, only changed ones are compiled again
+    std::vector<std::string> unitDirectories;  // searched for units after the program's own directory
+
+    // Returns false if the argument is not a known option
+    bool parse(const std::string& arg) {
+        if (arg == "-O0")
+            optLevel = OPT_0;
+        else if (arg == "-O1")
+            optLevel = OPT_1;
+        else if (arg == "-O2" || arg == "-O")
+            optLevel = OPT_2;
+        else if (arg == "-O3")
+            optLevel = OPT_3;
+        else if (arg == "-Os")
+            optLevel = OPT_SIZE;
+        else if (arg == "-Oz")
+            optLevel = OPT_MIN_SIZE;
+        else if (arg.rfind("-mcpu=", 0) == 0)
+            cpu = arg.substr(6);
+        else if (arg.rfind("-march=", 0) == 0)
+            cpu = arg.substr(7);
+        else if (arg.rfind("-mattr=", 0) == 0)
+            features += (features.empty() ? "" : ",") + arg.substr(7);
+        else if (arg.rfind("-fmultiversion=", 0) == 0)
+            multiversion = arg.substr(15);
+        else if (arg == "-fwhole-program")
+            wholeProgram = true;
+        else if (arg == "-fssa")
+            ssa = true;
+        else if (arg == "--run")
+            run = true;
+        else if (arg == "--vm")
+            vm = true;
+        else if (arg == "--tiered")
+            run = tiered = true;
+        else if (arg == "--lazy")
+            run = lazy = true;
+        else if (arg.rfind("--tier-threshold=", 0) == 0) {
+            unsigned value;
+            if (!parse_unsigned(arg.substr(17), value))
+                return false;
+            tierThreshold = std::max(1u, value);
+        }
+        else if (arg == "--cache")
+            cache = true;
+        else if (arg.rfind("--cache-dir=", 0) == 0) {
+            cache = true;
+            cacheDir = arg.substr(12);
+        }
+        else if (arg.rfind("--cache-size=", 0) == 0) {
+            if (!parse_unsigned(arg.substr(13), cacheSize))
+                return false;
+        }
+        else if (arg == "--incremental")
+            incremental = true;
+        else if (arg.rfind("-I", 0) == 0 && arg.size() > 2)
+            unitDirectories.push_back(arg.substr(2));
+        else if (arg == "-j")
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        else if (arg.rfind("-j", 0) == 0) {
+            unsigned value;
+            if (!parse_unsigned(arg.substr(2), value))
+                return false;
+            jobs = std::max(1u, value);
+        }
+        else
+            return false;
+        return true;
+    }
+
+    // Decimal digits that fit an unsigned, value is left alone otherwise
+    static bool parse_unsigned(const std::string& text, unsigned& value) {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        unsigned long long result = 0;
+        for (char digit : text)
+            if ((result = result * 10 + (digit - '0')) > std::numeric_limits<unsigned>::max())
+                return false;
+        value = static_cast<unsigned>(result);
+        return true;
+    }
+};
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_OPTIONS_H
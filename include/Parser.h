@@ -34,11 +34,15 @@ private:
     std::shared_ptr<VarExpression> parse_var();
     std::shared_ptr<BlockExpression> parse_block();
     std::shared_ptr<ParenthesesExpression> parse_parentheses();
-    std::shared_ptr<FunctionExpression> parse_function(bool procedure);
+    // In a unit interface only the header is there
+    std::shared_ptr<FunctionExpression> parse_function(bool procedure, bool header = false);
+    std::shared_ptr<UnitExpression> parse_unit();
+    std::list<std::string> parse_uses();
     std::shared_ptr<ConditionExpression> parse_condition();
+    std::shared_ptr<CaseExpression> parse_case();
     std::shared_ptr<WhileLoopExpression> parse_while();
     std::shared_ptr<ForLoopExpression> parse_for();
-    std::shared_ptr<BinaryOperationExpression> parse_minus();
+    ExpressionPointer parse_unary();    // -x, not x
     std::shared_ptr<BreakExpression> parse_break();
     std::shared_ptr<ExitExpression> parse_exit();
     std::shared_ptr<StringExpression> parse_string();
@@ -0,0 +1,16 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_RUNTIME_H
+#define BIE_PJP_MILALANGUAGECOMPILER_RUNTIME_H
+
+#include <cstddef>
+
+
+// runtime/runtime.c as bitcode, generated by the build
+extern const unsigned char g_runtimeBitcode[];
+extern const size_t g_runtimeBitcodeSize;
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_RUNTIME_H
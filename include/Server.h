@@ -0,0 +1,42 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_SERVER_H
+#define BIE_PJP_MILALANGUAGECOMPILER_SERVER_H
+
+#include <string>
+#include <vector>
+
+
+// Compiles for mila-client over a Unix-domain socket
+//
+// The process stays up, so LLVM's targets are registered once and requests
+// skip process startup and library loading. Each connection carries one
+// request, several are served at a time. Outputs are written to the paths
+// the client named, relative ones resolved against its working directory.
+// Running programs (--run, --lazy, --vm) is not served, their stdin and
+// stdout belong to the client.
+//
+// A request that hits an LLVM fatal error or crashes is answered with an
+// error, the server keeps going. Such a request is abandoned midway though,
+// whatever memory or lock it held stays taken; restart the server if
+// requests start to hang. A crash on a thread LLVM starts itself, as in
+// parallel code generation, still ends the server, mila-client then says so.
+// A client has 30 seconds to send its request.
+class Server {
+public:
+    Server(std::string socket, unsigned threads);
+    // Only returns on failure
+    void serve();
+
+private:
+    void handle(int connection);
+    static std::vector<std::string> resolve(const std::string& directory, std::vector<std::string> args);
+
+    std::string m_socket;
+    unsigned m_threads;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_SERVER_H
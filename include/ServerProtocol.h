@@ -0,0 +1,72 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_SERVERPROTOCOL_H
+#define BIE_PJP_MILALANGUAGECOMPILER_SERVERPROTOCOL_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+// What the server and mila-client say to each other over a Unix-domain socket
+//
+// Every message is a string preceded by its length as 4 little endian bytes.
+// A request is the client's working directory, the number of arguments, the
+// arguments and the source; the response is the exit status, then everything
+// the compiler printed to stdout and to stderr. Kept free of LLVM, the client
+// should start as fast as a process can.
+
+inline std::string default_server_socket() {
+    if (const char* path = std::getenv("MILA_SERVER_SOCKET"))
+        return path;
+    return "/tmp/mila-" + std::to_string(getuid()) + ".socket";
+}
+
+inline bool send_all(int socket, const char* data, size_t size) {
+    while (size) {
+        auto sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+inline bool receive_all(int socket, char* data, size_t size) {
+    while (size) {
+        auto received = recv(socket, data, size, 0);
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+inline bool send_message(int socket, const std::string& message) {
+    unsigned char length[4];
+    for (int i = 0; i < 4; i++)
+        length[i] = uint32_t(message.size()) >> (8 * i);
+    return send_all(socket, reinterpret_cast<const char*>(length), 4) &&
+           send_all(socket, message.data(), message.size());
+}
+
+inline bool receive_message(int socket, std::string& message) {
+    unsigned char length[4];
+    if (!receive_all(socket, reinterpret_cast<char*>(length), 4))
+        return false;
+    uint32_t size = 0;
+    for (int i = 0; i < 4; i++)
+        size |= uint32_t(length[i]) << (8 * i);
+    message.resize(size);
+    return receive_all(socket, &message[0], size);
+}
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_SERVERPROTOCOL_H
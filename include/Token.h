@@ -16,6 +16,7 @@ enum TokenType {
     TOK_ASSIGN,
     TOK_BEGIN,
     TOK_BREAK,
+    TOK_CASE,
     TOK_CLOSE_BRACKET,
     TOK_COMMA,
     TOK_COLON,
@@ -36,7 +37,9 @@ enum TokenType {
     TOK_FUNCTION,
     TOK_IDENTIFIER,
     TOK_IF,
+    TOK_IMPLEMENTATION,
     TOK_INTEGER,
+    TOK_INTERFACE,
     TOK_LESS,
     TOK_LESS_OR_EQUAL,
     TOK_MINUS,
@@ -44,16 +47,21 @@ enum TokenType {
     TOK_GREATER,
     TOK_GREATER_OR_EQUAL,
     TOK_MULTIPLY,
+    TOK_NOT,
     TOK_NOT_EQUAL,
+    TOK_OF,
     TOK_OPEN_BRACKET,
     TOK_OR,
     TOK_PLUS,
     TOK_PROCEDURE,
     TOK_PROGRAM,
+    TOK_RANGE,
     TOK_SEMICOLON,
     TOK_STRING,
     TOK_THEN,
     TOK_TO,
+    TOK_UNIT,
+    TOK_USES,
     TOK_VAR,
     TOK_VOID,
     TOK_WHILE
@@ -84,7 +92,12 @@ public:
                                                                     {TOK_PROGRAM, "program"},
                                                                     {TOK_SEMICOLON, ";"},
                                                                     {TOK_COMMA, ","},
-                                                                    {TOK_FORWARD, "forward"}};
+                                                                    {TOK_RANGE, ".."},
+                                                                    {TOK_FORWARD, "forward"},
+                                                                    {TOK_UNIT, "unit"},
+                                                                    {TOK_USES, "uses"},
+                                                                    {TOK_INTERFACE, "interface"},
+                                                                    {TOK_IMPLEMENTATION, "implementation"}};
         auto it = tokStrings.find(m_type);
         if (it == tokStrings.end())
             return "<?>";
@@ -0,0 +1,71 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_UNITBUILDER_H
+#define BIE_PJP_MILALANGUAGECOMPILER_UNITBUILDER_H
+
+#include "Expression.h"
+#include "Options.h"
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Finds, compiles and imports the units a program uses
+//
+// Unit u is u.mila in the program's directory or one given with -I. Compiling
+// it leaves the object u.o and the interface summary u.mi next to it. Both are
+// reused until the source, a unit it depends on or the code generation options
+// change, so a library is compiled once for every program using it; without a
+// source the two files alone will do. Units that do not depend on each other compile in parallel.
+class UnitBuilder {
+public:
+    UnitBuilder(Options options, std::vector<std::string> directories);
+
+    // The tree with the interfaces of its units, direct or not, merged in
+    std::shared_ptr<TopLevelExpression> import(std::shared_ptr<TopLevelExpression> tree);
+    // Compiles the named unit even if it is up to date, and what it uses if needed
+    void build(const std::string& name);
+
+    // Of the imported units, to be linked with the program
+    const std::vector<std::string>& objects() const { return m_objects; }
+    unsigned compiled() const { return m_compiled; }
+    const std::list<std::string>& warnings() const { return m_warnings; }
+
+private:
+    struct Unit {
+        std::string name;
+        std::string source;                     // empty for a precompiled unit
+        std::string object;
+        std::string summary;
+        std::shared_ptr<UnitExpression> tree;   // the source if stale, the summary otherwise
+        bool fromSource = false;
+        bool stale = false;
+        unsigned level = 0;                     // compiled after all units of lower levels
+        std::string error;                      // of the last compilation, set on a pool thread
+        std::list<std::string> warnings;
+    };
+
+    Unit& discover(const std::string& name, std::vector<std::string>& path);
+    void compile_stale();
+    void compile(Unit& unit);
+    std::shared_ptr<UnitExpression> parse(const std::string& file);
+    std::vector<const Unit*> closure(const std::list<std::string>& uses) const;
+    std::shared_ptr<TopLevelExpression> merge(std::shared_ptr<TopLevelExpression> tree,
+                                              const std::vector<const Unit*>& units);
+
+    Options m_options;
+    std::string m_optionsKey;                   // recorded in the summaries
+    std::vector<std::string> m_directories;
+    std::map<std::string, Unit> m_units;
+    std::vector<std::string> m_order;           // dependencies first
+    std::vector<std::string> m_objects;
+    unsigned m_compiled = 0;
+    std::list<std::string> m_warnings;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_UNITBUILDER_H
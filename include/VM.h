@@ -0,0 +1,33 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#ifndef BIE_PJP_MILALANGUAGECOMPILER_VM_H
+#define BIE_PJP_MILALANGUAGECOMPILER_VM_H
+
+#include "Bytecode.h"
+
+
+// Interprets a bytecode program with threaded dispatch
+class VM {
+public:
+    VM(const BytecodeProgram& program) : m_program(program) {}
+    int run();
+
+private:
+    struct Frame {
+        const BytecodeFunction* function;
+        const Instruction* returnTo;
+        size_t base;            // of the register window in m_stack
+        uint16_t result;        // caller's register for the return value
+    };
+
+    Value* window(size_t base, const BytecodeFunction& function);
+
+    const BytecodeProgram& m_program;
+    std::vector<Value> m_stack;
+    std::vector<Frame> m_frames;
+};
+
+
+#endif //BIE_PJP_MILALANGUAGECOMPILER_VM_H
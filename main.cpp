@@ -1,51 +1,98 @@
-#include "include/CodeGenerator.h"
+#include "include/Batch.h"
+#include "include/Driver.h"
 #include "include/Exception.h"
-#include "include/Parser.h"
+#include "include/Options.h"
+#include "include/Server.h"
+#include "include/ServerProtocol.h"
 
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
+#include <thread>
+#include <vector>
 
 
-int main(int argc, char* args[]) {
-    const char* fileName = args[1];
-    std::ifstream file;
-    file.open(fileName);
-    Parser parser(file);
+// LLVM's fatal errors end the compilation like ours do, without running destructors under its locks
+static void fatal_error(void*, const char* reason, bool) {
+    std::fflush(stdout);
+    std::cerr << "ERROR:\t" << reason << std::endl;
+    std::_Exit(2);
+}
 
-    if (file.fail()) {
-        std::cout << "File not open" << std::endl;
+// --batch compiles every listed source and those of --batch=<manifest> files, -j of them at a time
+static int batch(const std::vector<std::string>& arguments) {
+    Options options;
+    std::vector<std::string> shared, sources, manifests;
+    bool threadsGiven = false;
+    for (const auto& arg : arguments) {
+        if (arg == "--batch")
+            continue;
+        if (arg.rfind("--batch=", 0) == 0)
+            manifests.push_back(arg.substr(8));
+        else if (arg.size() > 1 && arg[0] == '-') {
+            if (!options.parse(arg)) {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+            // Files are compiled in parallel instead of each one's code generation
+            if (arg.rfind("-j", 0) == 0)
+                threadsGiven = true;
+            else
+                shared.push_back(arg);
+        } else
+            sources.push_back(arg);
+    }
+    if (options.run || options.vm) {
+        std::cerr << "ERROR:\t--run, --tiered, --lazy and --vm cannot be used with --batch" << std::endl;
+        return 1;
+    }
+
+    Batch batch(shared, threadsGiven ? options.jobs : std::max(1u, std::thread::hardware_concurrency()));
+    try {
+        for (const auto& manifest : manifests)
+            batch.add_manifest(manifest);
+    } catch (Exception& e) {
+        std::cerr << "ERROR:\t" << e.message() << std::endl;
+        return 2;
+    }
+    for (const auto& source : sources)
+        batch.add(source, "");
+    if (batch.jobs().empty()) {
+        std::cerr << "Usage: mila --batch[=<manifest>] [options] [<source>...]" << std::endl;
         return 1;
-    } else {
+    }
+
+    auto failed = batch.run();
+    batch.write_summary(std::cout);
+    auto files = batch.jobs().size();
+    std::cerr << "Compiled:\t" << files - failed << " of " << files << " files in " << batch.time() << " ms ("
+              << (batch.time() > 0 ? files * 1000 / batch.time() : 0) << " files/s)" << std::endl;
+    return failed ? 2 : 0;
+}
+
+int main(int argc, char* args[]) {
+    std::vector<std::string> arguments(args + 1, args + argc);
+    // --server[=<socket>] compiles for mila-client until killed
+    if (!arguments.empty() && arguments.front().rfind("--server", 0) == 0) {
+        const auto& server = arguments.front();
+        if (server != "--server" && server.rfind("--server=", 0) != 0) {
+            std::cerr << "Unknown option: " << server << std::endl;
+            return 1;
+        }
         try {
-            parser.parse();
-            const char* outFile = argc >= 3 ? args[2] : "output";
-            CodeGenerator generator(parser.get_tree());
-            generator.generate_code();
-            generator.print();
-            generator.write_output(outFile);
+            Server(server == "--server" ? default_server_socket() : server.substr(9),
+                   std::thread::hardware_concurrency()).serve();
         } catch (Exception& e) {
-            if (e.has_position()) {
-                auto pos = e.position();
-                std::cerr << "LINE " << pos.line << "; COLUMN " << pos.column << ':' << std::endl;
-                file.seekg(0, std::ios::beg);
-                std::string line;
-                for (int i = 0; i < pos.line; i++)
-                    std::getline(file, line);
-                std::cerr << line << std::endl;
-
-                for (int i = 0; i < pos.column - 1; i++)
-                    std::cerr << '~';
-                std::cerr << '^';
-                for (int i = pos.column; i < line.length(); i++)
-                    std::cerr << '~';
-                std::cerr << std::endl;
-            }
             std::cerr << "ERROR:\t" << e.message() << std::endl;
-            return 2;
         }
+        return 2;
     }
-    std::cout << parser.get_source() << std::endl;
-    file.close();
-
-    return 0;
+    llvm::install_fatal_error_handler(fatal_error);
+    if (std::any_of(arguments.begin(), arguments.end(), [](const std::string& arg) {
+            return arg == "--batch" || arg.rfind("--batch=", 0) == 0; }))
+        return batch(arguments);
+    return Driver(args[0], std::cout, std::cerr).run(arguments);
 }
@@ -0,0 +1,9 @@
+# cmake -DINPUT=runtime.bc -DOUTPUT=RuntimeBitcode.cpp -P embed.cmake
+# Turns the runtime's bitcode into the arrays Runtime.h declares
+file(READ ${INPUT} bytes HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${bytes}")
+file(WRITE ${OUTPUT}
+        "// Generated from ${INPUT}, do not edit\n"
+        "#include <cstddef>\n\n"
+        "extern const unsigned char g_runtimeBitcode[] = {${bytes}};\n"
+        "extern const size_t g_runtimeBitcodeSize = sizeof(g_runtimeBitcode);\n")
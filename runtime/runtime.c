@@ -0,0 +1,33 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+// What write, writeln and readln compile to. Built once into bitcode that is
+// embedded in the compiler; a module gets only the helpers it calls, as
+// private copies the optimizer can inline.
+
+#include <stdio.h>
+
+void writeInt(int value) {
+    printf("%d", value);
+}
+
+void writeLnInt(int value) {
+    printf("%d\n", value);
+}
+
+void writeDouble(double value) {
+    printf("%lf", value);
+}
+
+void writeLnDouble(double value) {
+    printf("%lf\n", value);
+}
+
+void readInt(int* value) {
+    scanf("%d[^\n]", value);
+}
+
+void readDouble(double* value) {
+    scanf("%lf[^\n]", value);
+}
@@ -0,0 +1,141 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/Batch.h"
+#include "../include/Driver.h"
+#include "../include/Exception.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+static std::string json_string(const std::string& text) {
+    std::string json = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': json += "\\\""; break;
+            case '\\': json += "\\\\"; break;
+            case '\n': json += "\\n"; break;
+            case '\t': json += "\\t"; break;
+            case '\r': json += "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    json += escaped;
+                } else
+                    json += c;
+        }
+    }
+    return json + '"';
+}
+
+Batch::Batch(std::vector<std::string> options, unsigned threads) :
+        m_options(std::move(options)),
+        m_threads(threads) {}
+
+void Batch::add(const std::string& source, const std::string& output) {
+    Job job;
+    job.source = source;
+    job.output = output;
+    // prog.mila builds prog and prog.bin
+    if (job.output.empty()) {
+        llvm::SmallString<128> path(source);
+        llvm::sys::path::replace_extension(path, "");
+        job.output = std::string(path.str());
+    }
+    m_jobs.push_back(std::move(job));
+}
+
+// Paths in a manifest are relative to its directory
+void Batch::add_manifest(const std::string& file) {
+    std::ifstream manifest(file);
+    if (manifest.fail())
+        throw Exception("Cannot open " + file);
+    auto directory = llvm::sys::path::parent_path(file);
+    auto resolve = [&directory](const std::string& path) {
+        if (path.empty() || llvm::sys::path::is_absolute(path))
+            return path;
+        llvm::SmallString<128> resolved(directory);
+        llvm::sys::path::append(resolved, path);
+        return std::string(resolved.str());
+    };
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        std::string source, output;
+        fields >> source >> output;
+        if (!source.empty() && source[0] != '#')
+            add(resolve(source), resolve(output));
+    }
+}
+
+void Batch::compile(Job& job) {
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream file(job.source);
+    if (file.fail()) {
+        job.status = 1;
+        job.diagnostics = "File not open\n";
+        return;
+    }
+    std::ostringstream source, out, err;
+    source << file.rdbuf();
+
+    auto args = m_options;
+    args.push_back(job.source);
+    args.push_back(job.output);
+    // The echoed source goes nowhere, the IR would drown the diagnostics
+    Driver driver("mila", out, err);
+    driver.print_ir(false);
+    job.status = driver.run(args, source.str());
+    job.diagnostics = err.str();
+    job.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned Batch::run() {
+    auto start = std::chrono::steady_clock::now();
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(m_threads));
+        for (auto& job : m_jobs)
+            pool.async([this, &job]() { compile(job); });
+        pool.wait();
+    }
+    m_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned failed = 0;
+    for (const auto& job : m_jobs)
+        failed += job.status != 0;
+    return failed;
+}
+
+void Batch::write_summary(std::ostream& stream) const {
+    unsigned failed = 0;
+    for (const auto& job : m_jobs)
+        failed += job.status != 0;
+
+    stream << "{\n"
+           << "  \"files\": " << m_jobs.size() << ",\n"
+           << "  \"failed\": " << failed << ",\n"
+           << "  \"threads\": " << m_threads << ",\n"
+           << "  \"time_ms\": " << m_time << ",\n"
+           << "  \"files_per_second\": " << (m_time > 0 ? m_jobs.size() * 1000 / m_time : 0) << ",\n"
+           << "  \"results\": [";
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+        const auto& job = m_jobs[i];
+        stream << (i ? ",\n" : "\n")
+               << "    {\"source\": " << json_string(job.source)
+               << ", \"output\": " << json_string(job.output)
+               << ", \"status\": " << job.status
+               << ", \"time_ms\": " << job.time
+               << ", \"diagnostics\": " << json_string(job.diagnostics) << '}';
+    }
+    stream << (m_jobs.empty() ? "]\n" : "\n  ]\n") << "}" << std::endl;
+}
@@ -0,0 +1,838 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/BytecodeCompiler.h"
+#include "../include/Exception.h"
+
+#include <cmath>
+#include <limits>
+
+
+static bool is_numeric(ValueType type) {
+    return type == VALUE_BOOLEAN || type == VALUE_INTEGER || type == VALUE_DOUBLE;
+}
+
+// Booleans are stored as 0 and 1, so an integer can hold one
+static bool can_store(ValueType to, ValueType from) {
+    return to == from || (to == VALUE_INTEGER && from == VALUE_BOOLEAN);
+}
+
+static ValueType value_type(TokenType type) {
+    switch (type) {
+        case TOK_INTEGER: return VALUE_INTEGER;
+        case TOK_DOUBLE: return VALUE_DOUBLE;
+        case TOK_STRING: return VALUE_STRING;
+        default: return VALUE_VOID;
+    }
+}
+
+static bool is_comparison(TokenType type) {
+    return type == TOK_EQUAL || type == TOK_NOT_EQUAL || type == TOK_LESS || type == TOK_LESS_OR_EQUAL
+           || type == TOK_GREATER || type == TOK_GREATER_OR_EQUAL;
+}
+
+BytecodeProgram BytecodeCompiler::compile() {
+    for (auto& c : m_tree->consts()) {
+        ValueType type;
+        auto value = constant(c.second, type);
+        m_constants[c.first] = {value, type};
+    }
+    for (auto& v : m_tree->vars()) {
+        m_globals[v.first] = {static_cast<uint16_t>(m_program.globals.size()), value_type(v.second)};
+        m_program.globals.push_back(Value());
+    }
+    m_globals["_extra"] = {static_cast<uint16_t>(m_program.globals.size()), VALUE_INTEGER};
+    m_program.globals.push_back(Value());
+
+    // Everything is declared up front so calls can be resolved in any order
+    auto functions = m_tree->functions();
+    for (const auto& function : functions)
+        declare_function(function);
+    m_program.main = static_cast<uint16_t>(m_program.functions.size());
+    m_program.functions.emplace_back();
+    m_program.functions.back().name = "main";
+    m_program.functions.back().defined = true;
+    m_prototypes.push_back({{}, VALUE_VOID});
+
+    for (const auto& function : functions)
+        if (function->body())
+            compile_function(function);
+    compile_main();
+
+    for (const auto& function : m_program.functions)
+        if (!function.defined)
+            throw Exception("Function is not defined: " + function.name);
+    return std::move(m_program);
+}
+
+void BytecodeCompiler::declare_function(const std::shared_ptr<FunctionExpression> expr) {
+    Prototype prototype;
+    for (auto type : expr->arg_types())
+        prototype.arguments.push_back(value_type(type));
+    prototype.result = value_type(expr->return_type());
+
+    auto known = m_functions.find(expr->name());
+    if (known != m_functions.end()) {
+        auto& other = m_prototypes[known->second];
+        if (other.arguments != prototype.arguments || other.result != prototype.result)
+            throw Exception(expr->position(), "Function redefinition: " + expr->name());
+        return;
+    }
+    if (m_program.functions.size() >= std::numeric_limits<uint16_t>::max())
+        throw Exception(expr->position(), "Too many functions");
+    m_functions[expr->name()] = static_cast<uint16_t>(m_program.functions.size());
+    m_program.functions.emplace_back();
+    m_program.functions.back().name = expr->name();
+    m_program.functions.back().arguments = static_cast<uint16_t>(prototype.arguments.size());
+    m_prototypes.push_back(std::move(prototype));
+}
+
+void BytecodeCompiler::compile_function(const std::shared_ptr<FunctionExpression> expr) {
+    auto index = m_functions[expr->name()];
+    m_code = &m_program.functions[index];
+    m_code->code.clear();
+    m_code->defined = true;
+    m_nextRegister = 0;
+    m_locals.clear();
+
+    // Arguments come first, in order, then the locals
+    auto argNames = expr->arg_names();
+    auto argTypes = expr->arg_types();
+    for (size_t i = 0; i < argNames.size(); i++)
+        m_locals[argNames[i]] = {new_register(), value_type(argTypes[i])};
+    auto oldConsts = m_constants;
+    for (auto& c : expr->consts()) {
+        ValueType type;
+        auto value = constant(c.second, type);
+        m_constants[c.first] = {value, type};
+    }
+    for (auto& v : expr->vars())
+        m_locals[v.first] = {new_register(), value_type(v.second)};
+    const Local* result = nullptr;
+    if (expr->return_type() != TOK_VOID) {
+        m_locals[expr->name()] = {new_register(), value_type(expr->return_type())};
+        result = &m_locals[expr->name()];
+    }
+
+    compile_statement(expr->body());
+    finish_function(result);
+    m_constants = oldConsts;
+    m_locals.clear();
+}
+
+void BytecodeCompiler::compile_main() {
+    m_code = &m_program.functions[m_program.main];
+    m_nextRegister = 0;
+    m_locals.clear();
+    compile_statement(m_tree->body());
+    finish_function(nullptr);
+}
+
+void BytecodeCompiler::finish_function(const Local* result) {
+    auto epilogue = here();
+    for (auto exit : m_exits)
+        patch(exit);
+    m_exits.clear();
+    if (result)
+        emit(OP_RETURN, result->reg);
+    else
+        emit(OP_RETURN_VOID);
+
+    // A call whose result goes straight to the epilogue can reuse the frame
+    auto& code = m_code->code;
+    for (size_t i = 0; i < code.size(); i++) {
+        if (code[i].op != OP_CALL)
+            continue;
+        auto next = i + 1;
+        while (code[next].op == OP_JUMP)
+            next = code[next].value;
+        if (next != static_cast<size_t>(epilogue))
+            continue;
+        auto calleeResult = m_prototypes[code[i].b].result;
+        if (result ? code[i].a == result->reg && calleeResult != VALUE_VOID : calleeResult == VALUE_VOID)
+            code[i].op = OP_TAIL_CALL;
+    }
+    m_code->registers = std::max(m_code->registers, m_nextRegister);
+    m_code = nullptr;
+}
+
+void BytecodeCompiler::compile_statement(const ExpressionPointer expr) {
+    // Temporaries live until the end of the statement
+    auto mark = m_nextRegister;
+    switch (expr->type()) {
+        case EXPR_ASSIGN:
+            compile_assign(std::static_pointer_cast<AssignExpression>(expr));
+            break;
+        case EXPR_BLOCK:
+            for (const auto& e : std::static_pointer_cast<BlockExpression>(expr)->body())
+                compile_statement(e);
+            break;
+        case EXPR_CONDITION:
+            compile_condition(std::static_pointer_cast<ConditionExpression>(expr));
+            break;
+        case EXPR_CASE:
+            compile_case(std::static_pointer_cast<CaseExpression>(expr));
+            break;
+        case EXPR_WHILE_LOOP:
+            compile_while(std::static_pointer_cast<WhileLoopExpression>(expr));
+            break;
+        case EXPR_FOR_LOOP:
+            compile_for(std::static_pointer_cast<ForLoopExpression>(expr));
+            break;
+        case EXPR_BREAK:
+            if (!m_breaks)
+                throw Exception(expr->position(), "Break statement outside of loop");
+            m_breaks->push_back(emit(OP_JUMP));
+            break;
+        case EXPR_EXIT:
+            m_exits.push_back(emit(OP_JUMP));
+            break;
+        default:
+            compile_expression(expr);
+            break;
+    }
+    m_nextRegister = mark;
+}
+
+void BytecodeCompiler::compile_assign(const std::shared_ptr<AssignExpression> expr) {
+    assign(expr->name(), expr->value(), expr->position());
+}
+
+void BytecodeCompiler::assign(const std::string& name, const ExpressionPointer value, TextPosition position) {
+    if (m_loopCounters.count(name))
+        throw Exception(position, "Cannot change for-loop counter: " + name);
+    auto local = m_locals.find(name);
+    if (local != m_locals.end()) {
+        auto result = compile_expression(value, local->second.reg);
+        if (!can_store(local->second.type, result.type))
+            throw Exception(position, "Type mismatch in assignment to " + name);
+        if (result.reg != local->second.reg)
+            emit(OP_MOVE, local->second.reg, result.reg);
+        return;
+    }
+    auto global = m_globals.find(name);
+    if (global != m_globals.end()) {
+        auto result = compile_expression(value);
+        if (!can_store(global->second.type, result.type))
+            throw Exception(position, "Type mismatch in assignment to " + name);
+        emit(OP_STORE_GLOBAL, result.reg, 0, 0, global->second.reg);
+        return;
+    }
+    if (m_constants.count(name))
+        throw Exception(position, "Cannot change constant: " + name);
+    throw Exception(position, "Unknown identifier: " + name);
+}
+
+void BytecodeCompiler::compile_condition(const std::shared_ptr<ConditionExpression> expr) {
+    auto toElse = compile_branch(expr->condition(), false);
+    compile_statement(expr->thenBody());
+    if (expr->elseBody()) {
+        auto toEnd = emit(OP_JUMP);
+        patch(toElse);
+        compile_statement(expr->elseBody());
+        patch(toEnd);
+    } else
+        patch(toElse);
+}
+
+void BytecodeCompiler::compile_case(const std::shared_ptr<CaseExpression> expr) {
+    auto selector = compile_expression(expr->selector());
+    if (selector.type != VALUE_INTEGER)
+        throw Exception(expr->selector()->position(), "Case selector must be an integer");
+
+    // Tests for all labels first, then the else-branch, then the bodies
+    std::map<int32_t, int32_t> covered;    // low -> high, for overlap detection
+    std::vector<std::vector<size_t>> toBranch;
+    auto low = new_register(), high = new_register();
+    for (const auto& branch : expr->branches()) {
+        toBranch.emplace_back();
+        for (const auto& label : branch.labels) {
+            ValueType type;
+            auto lowValue = constant(label.first, type).i;
+            if (type != VALUE_INTEGER)
+                throw Exception(label.first->position(), "Case label must be an integer constant");
+            auto highValue = lowValue;
+            if (label.second) {
+                highValue = constant(label.second, type).i;
+                if (type != VALUE_INTEGER)
+                    throw Exception(label.second->position(), "Case label must be an integer constant");
+            }
+            if (lowValue > highValue)
+                throw Exception(label.first->position(), "Empty case range");
+            auto next = covered.upper_bound(lowValue);
+            if ((next != covered.end() && next->first <= highValue)
+                    || (next != covered.begin() && std::prev(next)->second >= lowValue))
+                throw Exception(label.first->position(), "Duplicate case label");
+            covered[lowValue] = highValue;
+
+            emit(OP_LOAD_INT, low, 0, 0, lowValue);
+            if (lowValue == highValue) {
+                toBranch.back().push_back(emit(OP_JUMP_IF_EQ, selector.reg, low));
+                continue;
+            }
+            emit(OP_LOAD_INT, high, 0, 0, highValue);
+            auto below = emit(OP_JUMP_IF_LT, selector.reg, low);
+            toBranch.back().push_back(emit(OP_JUMP_IF_LE, selector.reg, high));
+            patch(below);
+        }
+    }
+
+    std::vector<size_t> toEnd;
+    if (expr->otherwise())
+        compile_statement(expr->otherwise());
+    toEnd.push_back(emit(OP_JUMP));
+    auto jumps = toBranch.begin();
+    for (const auto& branch : expr->branches()) {
+        for (auto jump : *jumps++)
+            patch(jump);
+        if (branch.body)
+            compile_statement(branch.body);
+        toEnd.push_back(emit(OP_JUMP));
+    }
+    for (auto jump : toEnd)
+        patch(jump);
+}
+
+void BytecodeCompiler::compile_while(const std::shared_ptr<WhileLoopExpression> expr) {
+    // Rotated: the condition is tested once before the loop and then at the bottom
+    std::vector<size_t> breaks;
+    breaks.push_back(compile_branch(expr->condition(), false));
+    auto top = here();
+
+    auto outerBreaks = m_breaks;
+    m_breaks = &breaks;
+    compile_statement(expr->body());
+    m_breaks = outerBreaks;
+
+    m_code->code[compile_branch(expr->condition(), true)].value = top;
+    for (auto jump : breaks)
+        patch(jump);
+}
+
+void BytecodeCompiler::compile_for(const std::shared_ptr<ForLoopExpression> expr) {
+    const auto& name = expr->counter();
+    const Local* counter = nullptr;
+    auto local = m_locals.find(name);
+    auto global = m_globals.find(name);
+    if (local != m_locals.end())
+        counter = &local->second;
+    else if (global != m_globals.end())
+        counter = &global->second;
+    else if (m_constants.count(name))
+        throw Exception(expr->position(), "Cannot change constant: " + name);
+    else
+        throw Exception(expr->position(), "Unknown identifier: " + name);
+    if (counter->type != VALUE_INTEGER)
+        throw Exception(expr->position(), "For-loop counter must be an integer");
+    if (m_loopCounters.count(name))
+        throw Exception(expr->position(), "Cannot change for-loop counter: " + name);
+
+    // Both bounds are evaluated before the counter changes
+    auto start = compile_expression(expr->start());
+    auto finish = compile_expression(expr->finish(), new_register());
+    if (start.type != VALUE_INTEGER || finish.type != VALUE_INTEGER)
+        throw Exception(expr->position(), "For-loop bounds must be integers");
+
+    // Globals are counted in a register and written back on every step
+    auto inductionVar = local != m_locals.end() ? counter->reg : new_register();
+    emit(OP_MOVE, inductionVar, start.reg);
+    if (local == m_locals.end())
+        emit(OP_STORE_GLOBAL, inductionVar, 0, 0, counter->reg);
+
+    // Same shape as the native loop: |finish - start| iterations, tested at the bottom
+    std::vector<size_t> breaks;
+    breaks.push_back(emit(expr->down() ? OP_JUMP_IF_LE : OP_JUMP_IF_GE, inductionVar, finish.reg));
+    auto top = here();
+
+    auto outerBreaks = m_breaks;
+    m_breaks = &breaks;
+    m_loopCounters.insert(name);
+    compile_statement(expr->body());
+    m_loopCounters.erase(name);
+    m_breaks = outerBreaks;
+
+    emit(expr->down() ? OP_DEC : OP_INC, inductionVar);
+    if (local == m_locals.end())
+        emit(OP_STORE_GLOBAL, inductionVar, 0, 0, counter->reg);
+    emit(OP_JUMP_IF_NE, inductionVar, finish.reg, 0, top);
+    for (auto jump : breaks)
+        patch(jump);
+}
+
+// Emits a jump taken when the condition equals jumpIf and returns it for patching
+size_t BytecodeCompiler::compile_branch(const ExpressionPointer condition, bool jumpIf) {
+    auto mark = m_nextRegister;
+    auto expr = condition;
+    while (expr->type() == EXPR_PARENTHESES)
+        expr = std::static_pointer_cast<ParenthesesExpression>(expr)->expression();
+
+    // Integer comparisons jump directly
+    if (expr->type() == EXPR_BINARY_OPERATION) {
+        auto binary = std::static_pointer_cast<BinaryOperationExpression>(expr);
+        auto opType = binary->op()->type();
+        if (is_comparison(opType)) {
+            auto left = compile_expression(binary->left());
+            auto right = compile_expression(binary->right());
+            if (!is_numeric(left.type) || !is_numeric(right.type))
+                throw Exception(expr->position(), "Invalid operand of '" + binary->op()->to_string() + '\'');
+            if (left.type == VALUE_DOUBLE || right.type == VALUE_DOUBLE) {
+                // NaN makes every ordered comparison false, so these cannot be inverted
+                Opcode op;
+                switch (opType) {
+                    case TOK_EQUAL: op = OP_FEQ; break;
+                    case TOK_NOT_EQUAL: op = OP_FNE; break;
+                    case TOK_LESS: op = OP_FLT; break;
+                    case TOK_LESS_OR_EQUAL: op = OP_FLE; break;
+                    case TOK_GREATER: op = OP_FGT; break;
+                    default: op = OP_FGE; break;
+                }
+                left = to_double(left);
+                right = to_double(right);
+                auto reg = new_register();
+                emit(op, reg, left.reg, right.reg);
+                m_nextRegister = mark;
+                return emit(jumpIf ? OP_JUMP_IF_NOT_ZERO : OP_JUMP_IF_ZERO, reg);
+            }
+            if (!jumpIf) {
+                switch (opType) {
+                    case TOK_EQUAL: opType = TOK_NOT_EQUAL; break;
+                    case TOK_NOT_EQUAL: opType = TOK_EQUAL; break;
+                    case TOK_LESS: opType = TOK_GREATER_OR_EQUAL; break;
+                    case TOK_LESS_OR_EQUAL: opType = TOK_GREATER; break;
+                    case TOK_GREATER: opType = TOK_LESS_OR_EQUAL; break;
+                    default: opType = TOK_LESS; break;
+                }
+            }
+            Opcode op;
+            switch (opType) {
+                case TOK_EQUAL: op = OP_JUMP_IF_EQ; break;
+                case TOK_NOT_EQUAL: op = OP_JUMP_IF_NE; break;
+                case TOK_LESS: op = OP_JUMP_IF_LT; break;
+                case TOK_LESS_OR_EQUAL: op = OP_JUMP_IF_LE; break;
+                case TOK_GREATER: op = OP_JUMP_IF_GT; break;
+                default: op = OP_JUMP_IF_GE; break;
+            }
+            m_nextRegister = mark;
+            return emit(op, left.reg, right.reg);
+        }
+    }
+    if (expr->type() == EXPR_UNARY_OPERATION) {
+        auto unary = std::static_pointer_cast<UnaryOperationExpression>(expr);
+        if (unary->op() == TOK_NOT && unary->operand()->is_boolean())
+            return compile_branch(unary->operand(), !jumpIf);
+    }
+
+    auto value = compile_expression(condition);
+    if (!is_numeric(value.type) || value.type == VALUE_DOUBLE)
+        throw Exception(condition->position(), "Condition must be a boolean expression");
+    m_nextRegister = mark;
+    return emit(jumpIf ? OP_JUMP_IF_NOT_ZERO : OP_JUMP_IF_ZERO, value.reg);
+}
+
+Operand BytecodeCompiler::compile_expression(const ExpressionPointer expr, int target) {
+    auto destination = [&]() { return target >= 0 ? static_cast<uint16_t>(target) : new_register(); };
+    switch (expr->type()) {
+        case EXPR_INTEGER: {
+            auto reg = destination();
+            emit(OP_LOAD_INT, reg, 0, 0, std::static_pointer_cast<IntegerExpression>(expr)->value());
+            return {reg, VALUE_INTEGER};
+        }
+        case EXPR_DOUBLE: {
+            auto reg = destination();
+            Value value;
+            value.d = std::static_pointer_cast<DoubleExpression>(expr)->value();
+            emit(OP_LOAD_CONST, reg, 0, 0, static_cast<int32_t>(m_program.constants.size()));
+            m_program.constants.push_back(value);
+            return {reg, VALUE_DOUBLE};
+        }
+        case EXPR_IDENTIFIER: {
+            auto identifier = std::static_pointer_cast<IdentifierExpression>(expr);
+            return compile_identifier(identifier->value(), identifier->position(), target);
+        }
+        case EXPR_PARENTHESES:
+            return compile_expression(std::static_pointer_cast<ParenthesesExpression>(expr)->expression(), target);
+        case EXPR_BINARY_OPERATION:
+            return compile_binary_operation(std::static_pointer_cast<BinaryOperationExpression>(expr), target);
+        case EXPR_UNARY_OPERATION:
+            return compile_unary_operation(std::static_pointer_cast<UnaryOperationExpression>(expr), target);
+        case EXPR_CALL:
+            return compile_call(std::static_pointer_cast<CallExpression>(expr), target);
+        case EXPR_STRING:
+            throw Exception(expr->position(), "A string can only be written");
+        default:
+            throw Exception(expr->position(), "NOT IMPLEMENTED");
+    }
+}
+
+Operand BytecodeCompiler::compile_identifier(const std::string& name, TextPosition position, int target) {
+    auto destination = [&]() { return target >= 0 ? static_cast<uint16_t>(target) : new_register(); };
+    auto c = m_constants.find(name);
+    if (c != m_constants.end()) {
+        auto reg = destination();
+        if (c->second.second == VALUE_DOUBLE) {
+            emit(OP_LOAD_CONST, reg, 0, 0, static_cast<int32_t>(m_program.constants.size()));
+            m_program.constants.push_back(c->second.first);
+        } else
+            emit(OP_LOAD_INT, reg, 0, 0, c->second.first.i);
+        return {reg, c->second.second};
+    }
+    auto local = m_locals.find(name);
+    if (local != m_locals.end()) {
+        if (target >= 0 && target != local->second.reg)
+            emit(OP_MOVE, target, local->second.reg);
+        return {target >= 0 ? static_cast<uint16_t>(target) : local->second.reg, local->second.type};
+    }
+    auto global = m_globals.find(name);
+    if (global != m_globals.end()) {
+        auto reg = destination();
+        emit(OP_LOAD_GLOBAL, reg, 0, 0, global->second.reg);
+        return {reg, global->second.type};
+    }
+    throw Exception(std::move(position), "Unknown identifier: " + name);
+}
+
+Operand BytecodeCompiler::compile_binary_operation(const std::shared_ptr<BinaryOperationExpression> expr,
+                                                   int target) {
+    auto opType = expr->op()->type();
+    if ((opType == TOK_AND || opType == TOK_OR) && expr->left()->is_boolean() && expr->right()->is_boolean())
+        return compile_logical(expr, target);
+
+    auto left = compile_expression(expr->left());
+    auto right = compile_expression(expr->right());
+    if (!is_numeric(left.type) || !is_numeric(right.type))
+        throw Exception(expr->position(), "Invalid operand of '" + expr->op()->to_string() + '\'');
+    auto reg = target >= 0 ? static_cast<uint16_t>(target) : new_register();
+
+    if (left.type == VALUE_DOUBLE || right.type == VALUE_DOUBLE) {
+        left = to_double(left);
+        right = to_double(right);
+        Opcode op;
+        ValueType type = VALUE_DOUBLE;
+        switch (opType) {
+            case TOK_PLUS: op = OP_FADD; break;
+            case TOK_MINUS: op = OP_FSUB; break;
+            case TOK_MULTIPLY: op = OP_FMUL; break;
+            case TOK_DIVIDE: op = OP_FDIV; break;
+            case TOK_MOD: op = OP_FMOD; break;
+            case TOK_EQUAL: op = OP_FEQ; type = VALUE_BOOLEAN; break;
+            case TOK_NOT_EQUAL: op = OP_FNE; type = VALUE_BOOLEAN; break;
+            case TOK_LESS: op = OP_FLT; type = VALUE_BOOLEAN; break;
+            case TOK_LESS_OR_EQUAL: op = OP_FLE; type = VALUE_BOOLEAN; break;
+            case TOK_GREATER: op = OP_FGT; type = VALUE_BOOLEAN; break;
+            case TOK_GREATER_OR_EQUAL: op = OP_FGE; type = VALUE_BOOLEAN; break;
+            default:
+                throw Exception(expr->position(), "Operator '" + expr->op()->to_string()
+                                                  + "' cannot be applied to a double");
+        }
+        emit(op, reg, left.reg, right.reg);
+        return {reg, type};
+    }
+
+    Opcode op;
+    ValueType type = VALUE_INTEGER;
+    switch (opType) {
+        case TOK_PLUS: op = OP_ADD; break;
+        case TOK_MINUS: op = OP_SUB; break;
+        case TOK_MULTIPLY: op = OP_MUL; break;
+        case TOK_DIVIDE:
+        case TOK_DIV: op = OP_DIV; break;
+        case TOK_MOD: op = OP_MOD; break;
+        case TOK_AND:
+            op = OP_AND;
+            type = left.type == VALUE_BOOLEAN && right.type == VALUE_BOOLEAN ? VALUE_BOOLEAN : VALUE_INTEGER;
+            break;
+        case TOK_OR:
+            op = OP_OR;
+            type = left.type == VALUE_BOOLEAN && right.type == VALUE_BOOLEAN ? VALUE_BOOLEAN : VALUE_INTEGER;
+            break;
+        case TOK_EQUAL: op = OP_EQ; type = VALUE_BOOLEAN; break;
+        case TOK_NOT_EQUAL: op = OP_NE; type = VALUE_BOOLEAN; break;
+        case TOK_LESS: op = OP_LT; type = VALUE_BOOLEAN; break;
+        case TOK_LESS_OR_EQUAL: op = OP_LE; type = VALUE_BOOLEAN; break;
+        case TOK_GREATER: op = OP_GT; type = VALUE_BOOLEAN; break;
+        case TOK_GREATER_OR_EQUAL: op = OP_GE; type = VALUE_BOOLEAN; break;
+        default: throw Exception(expr->position(), "NOT IMPLEMENTED");
+    }
+    emit(op, reg, left.reg, right.reg);
+    return {reg, type};
+}
+
+Operand BytecodeCompiler::compile_unary_operation(const std::shared_ptr<UnaryOperationExpression> expr,
+                                                  int target) {
+    auto operand = compile_expression(expr->operand());
+    if (!is_numeric(operand.type))
+        throw Exception(expr->position(), "Invalid operand of a unary operator");
+    auto reg = target >= 0 ? static_cast<uint16_t>(target) : new_register();
+    switch (expr->op()) {
+        case TOK_MINUS:
+            if (operand.type == VALUE_DOUBLE) {
+                emit(OP_FNEG, reg, operand.reg);
+                return {reg, VALUE_DOUBLE};
+            }
+            emit(OP_NEG, reg, operand.reg);
+            return {reg, VALUE_INTEGER};
+        case TOK_NOT:
+            if (operand.type == VALUE_DOUBLE)
+                throw Exception(expr->position(), "Operator 'not' cannot be applied to a double");
+            emit(operand.type == VALUE_BOOLEAN ? OP_NOT_BOOLEAN : OP_NOT, reg, operand.reg);
+            return {reg, operand.type};
+        default:
+            throw Exception(expr->position(), "NOT IMPLEMENTED");
+    }
+}
+
+Operand BytecodeCompiler::compile_logical(const std::shared_ptr<BinaryOperationExpression> expr, int target) {
+    // The result register holds the left side until the right one is needed,
+    // a fresh one so that the right side still sees the old value of the target
+    bool isAnd = expr->op()->type() == TOK_AND;
+    auto reg = new_register();
+    auto left = compile_expression(expr->left(), reg);
+    if (!is_numeric(left.type) || left.type == VALUE_DOUBLE)
+        throw Exception(expr->left()->position(), "Invalid operand of '" + expr->op()->to_string() + '\'');
+    auto done = emit(isAnd ? OP_JUMP_IF_ZERO : OP_JUMP_IF_NOT_ZERO, reg);
+    auto right = compile_expression(expr->right(), reg);
+    if (!is_numeric(right.type) || right.type == VALUE_DOUBLE)
+        throw Exception(expr->right()->position(), "Invalid operand of '" + expr->op()->to_string() + '\'');
+    patch(done);
+    if (target >= 0) {
+        emit(OP_MOVE, target, reg);
+        reg = static_cast<uint16_t>(target);
+    }
+    return {reg, VALUE_BOOLEAN};
+}
+
+Operand BytecodeCompiler::compile_call(const std::shared_ptr<CallExpression> expr, int target) {
+    if (expr->number_of_args() == 1) {
+        if (expr->name() == "write")
+            return compile_write(expr, false);
+        if (expr->name() == "writeln")
+            return compile_write(expr, true);
+        if (expr->name() == "readln")
+            return compile_read(expr);
+    }
+    auto known = m_functions.find(expr->name());
+    if (known == m_functions.end())
+        throw Exception(expr->position(), "Function is not defined: " + expr->name());
+    const auto& prototype = m_prototypes[known->second];
+
+    if (expr->number_of_args() != prototype.arguments.size()) {
+        TextPosition argPos = expr->position();
+        argPos.column += expr->name().length() + 1;
+        throw Exception(argPos,
+                "Expected "
+                + std::to_string(prototype.arguments.size())
+                + " arguments - got "
+                + std::to_string(expr->number_of_args()));
+    }
+
+    // Arguments go to consecutive registers, reserved before any of them is computed
+    auto first = m_nextRegister;
+    for (size_t i = 0; i < prototype.arguments.size(); i++)
+        new_register();
+    size_t i = 0;
+    for (const auto& arg : expr->args()) {
+        auto value = compile_expression(arg, first + i);
+        if (!can_store(prototype.arguments[i], value.type))
+            throw Exception(arg->position(), "Argument " + std::to_string(i + 1) + " has a wrong type");
+        i++;
+    }
+    auto reg = target >= 0 ? static_cast<uint16_t>(target) : new_register();
+    emit(OP_CALL, reg, known->second, first);
+    return {reg, prototype.result};
+}
+
+Operand BytecodeCompiler::compile_write(const std::shared_ptr<CallExpression> expr, bool newline) {
+    auto arg = *expr->args().cbegin();
+    auto c = arg->type() == EXPR_IDENTIFIER
+             ? m_constants.find(std::static_pointer_cast<IdentifierExpression>(arg)->value()) : m_constants.end();
+    if (arg->type() == EXPR_STRING || (c != m_constants.end() && c->second.second == VALUE_STRING)) {
+        auto str = arg->type() == EXPR_STRING ? std::static_pointer_cast<StringExpression>(arg)->string()
+                                              : m_program.strings[c->second.first.i];
+        if (newline)
+            str += '\n';
+        emit(OP_WRITE_STRING, 0, 0, 0, static_cast<int32_t>(m_program.strings.size()));
+        m_program.strings.push_back(std::move(str));
+        return {0, VALUE_VOID};
+    }
+
+    auto value = compile_expression(arg);
+    if (value.type == VALUE_INTEGER)
+        emit(newline ? OP_WRITELN_INT : OP_WRITE_INT, value.reg);
+    else if (value.type == VALUE_DOUBLE)
+        emit(newline ? OP_WRITELN_DOUBLE : OP_WRITE_DOUBLE, value.reg);
+    else
+        throw Exception(expr->position(), "Function is not defined: " + expr->name());
+    return {0, VALUE_VOID};
+}
+
+Operand BytecodeCompiler::compile_read(const std::shared_ptr<CallExpression> expr) {
+    auto arg = *expr->args().cbegin();
+    if (arg->type() != EXPR_IDENTIFIER)
+        throw Exception(arg->position(), "Can only read into a variable");
+    auto name = std::static_pointer_cast<IdentifierExpression>(arg)->value();
+    if (m_loopCounters.count(name))
+        throw Exception(arg->position(), "Cannot read to for-loop counter");
+
+    auto local = m_locals.find(name);
+    auto global = m_globals.find(name);
+    const Local* variable;
+    if (local != m_locals.end())
+        variable = &local->second;
+    else if (global != m_globals.end())
+        variable = &global->second;
+    else if (m_constants.count(name))
+        throw Exception(arg->position(), "Cannot read to constant");
+    else
+        throw Exception(arg->position(), "Unknown identifier: " + name);
+    if (variable->type != VALUE_INTEGER && variable->type != VALUE_DOUBLE)
+        throw Exception(expr->position(), "Function is not defined: readln");
+
+    auto op = variable->type == VALUE_INTEGER ? OP_READ_INT : OP_READ_DOUBLE;
+    if (local != m_locals.end())
+        emit(op, variable->reg);
+    else {
+        auto reg = new_register();
+        emit(OP_LOAD_GLOBAL, reg, 0, 0, variable->reg);
+        emit(op, reg);
+        emit(OP_STORE_GLOBAL, reg, 0, 0, variable->reg);
+    }
+    auto zero = new_register();
+    emit(OP_LOAD_INT, zero);
+    emit(OP_STORE_GLOBAL, zero, 0, 0, m_globals["_extra"].reg);
+    return {0, VALUE_VOID};
+}
+
+// Constants may be arbitrary expressions over literals and other constants
+bool BytecodeCompiler::fold(const ExpressionPointer expr, Value& value, ValueType& type) {
+    switch (expr->type()) {
+        case EXPR_INTEGER:
+            value.i = std::static_pointer_cast<IntegerExpression>(expr)->value();
+            type = VALUE_INTEGER;
+            return true;
+        case EXPR_DOUBLE:
+            value.d = std::static_pointer_cast<DoubleExpression>(expr)->value();
+            type = VALUE_DOUBLE;
+            return true;
+        case EXPR_STRING:
+            value.i = static_cast<int32_t>(m_program.strings.size());
+            m_program.strings.push_back(std::static_pointer_cast<StringExpression>(expr)->string());
+            type = VALUE_STRING;
+            return true;
+        case EXPR_PARENTHESES:
+            return fold(std::static_pointer_cast<ParenthesesExpression>(expr)->expression(), value, type);
+        case EXPR_IDENTIFIER: {
+            auto c = m_constants.find(std::static_pointer_cast<IdentifierExpression>(expr)->value());
+            if (c == m_constants.end())
+                return false;
+            value = c->second.first;
+            type = c->second.second;
+            return true;
+        }
+        case EXPR_UNARY_OPERATION: {
+            auto unary = std::static_pointer_cast<UnaryOperationExpression>(expr);
+            if (!fold(unary->operand(), value, type) || !is_numeric(type))
+                return false;
+            if (unary->op() == TOK_MINUS) {
+                if (type == VALUE_DOUBLE)
+                    value.d = -value.d;
+                else {
+                    value.i = static_cast<int32_t>(0u - static_cast<uint32_t>(value.i));
+                    type = VALUE_INTEGER;
+                }
+                return true;
+            }
+            if (type == VALUE_DOUBLE)
+                return false;
+            value.i = type == VALUE_BOOLEAN ? !value.i : ~value.i;
+            return true;
+        }
+        case EXPR_BINARY_OPERATION: {
+            auto binary = std::static_pointer_cast<BinaryOperationExpression>(expr);
+            Value left, right;
+            ValueType leftType, rightType;
+            if (!fold(binary->left(), left, leftType) || !fold(binary->right(), right, rightType)
+                    || !is_numeric(leftType) || !is_numeric(rightType))
+                return false;
+            auto opType = binary->op()->type();
+            if (leftType == VALUE_DOUBLE || rightType == VALUE_DOUBLE) {
+                auto l = leftType == VALUE_DOUBLE ? left.d : left.i;
+                auto r = rightType == VALUE_DOUBLE ? right.d : right.i;
+                type = is_comparison(opType) ? VALUE_BOOLEAN : VALUE_DOUBLE;
+                switch (opType) {
+                    case TOK_PLUS: value.d = l + r; return true;
+                    case TOK_MINUS: value.d = l - r; return true;
+                    case TOK_MULTIPLY: value.d = l * r; return true;
+                    case TOK_DIVIDE: value.d = l / r; return true;
+                    case TOK_MOD: value.d = std::fmod(l, r); return true;
+                    case TOK_EQUAL: value.i = l == r; return true;
+                    case TOK_NOT_EQUAL: value.i = l < r || l > r; return true;
+                    case TOK_LESS: value.i = l < r; return true;
+                    case TOK_LESS_OR_EQUAL: value.i = l <= r; return true;
+                    case TOK_GREATER: value.i = l > r; return true;
+                    case TOK_GREATER_OR_EQUAL: value.i = l >= r; return true;
+                    default: return false;
+                }
+            }
+            auto l = static_cast<uint32_t>(left.i), r = static_cast<uint32_t>(right.i);
+            type = is_comparison(opType) ? VALUE_BOOLEAN : VALUE_INTEGER;
+            switch (opType) {
+                case TOK_PLUS: value.i = static_cast<int32_t>(l + r); return true;
+                case TOK_MINUS: value.i = static_cast<int32_t>(l - r); return true;
+                case TOK_MULTIPLY: value.i = static_cast<int32_t>(l * r); return true;
+                case TOK_DIVIDE:
+                case TOK_DIV:
+                case TOK_MOD:
+                    // Left to the VM, which traps at run time like the native code
+                    if (right.i == 0 || (right.i == -1 && left.i == std::numeric_limits<int32_t>::min()))
+                        return false;
+                    value.i = opType == TOK_MOD ? left.i % right.i : left.i / right.i;
+                    return true;
+                case TOK_AND:
+                    value.i = left.i & right.i;
+                    type = leftType == VALUE_BOOLEAN && rightType == VALUE_BOOLEAN ? VALUE_BOOLEAN : VALUE_INTEGER;
+                    return true;
+                case TOK_OR:
+                    value.i = left.i | right.i;
+                    type = leftType == VALUE_BOOLEAN && rightType == VALUE_BOOLEAN ? VALUE_BOOLEAN : VALUE_INTEGER;
+                    return true;
+                case TOK_EQUAL: value.i = left.i == right.i; return true;
+                case TOK_NOT_EQUAL: value.i = left.i != right.i; return true;
+                case TOK_LESS: value.i = left.i < right.i; return true;
+                case TOK_LESS_OR_EQUAL: value.i = left.i <= right.i; return true;
+                case TOK_GREATER: value.i = left.i > right.i; return true;
+                case TOK_GREATER_OR_EQUAL: value.i = left.i >= right.i; return true;
+                default: return false;
+            }
+        }
+        default:
+            return false;
+    }
+}
+
+Value BytecodeCompiler::constant(const ExpressionPointer expr, ValueType& type) {
+    Value value;
+    if (!fold(expr, value, type))
+        throw Exception(expr->position(), "Constant must be a constant expression");
+    return value;
+}
+
+Operand BytecodeCompiler::to_double(Operand operand) {
+    if (operand.type == VALUE_DOUBLE)
+        return operand;
+    auto reg = new_register();
+    emit(OP_TO_DOUBLE, reg, operand.reg);
+    return {reg, VALUE_DOUBLE};
+}
+
+uint16_t BytecodeCompiler::new_register() {
+    if (m_nextRegister == std::numeric_limits<uint16_t>::max())
+        throw Exception("Function '" + m_code->name + "' needs too many registers");
+    m_code->registers = std::max<uint16_t>(m_code->registers, m_nextRegister + 1);
+    return m_nextRegister++;
+}
+
+size_t BytecodeCompiler::emit(Opcode op, uint16_t a, uint16_t b, uint16_t c, int32_t value) {
+    m_code->code.push_back({op, a, b, c, value});
+    return m_code->code.size() - 1;
+}
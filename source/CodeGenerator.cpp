@@ -4,18 +4,35 @@
 
 #include "../include/CodeGenerator.h"
 #include "../include/Exception.h"
-
+#include "../include/Linker.h"
+#include "../include/Runtime.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+
+#include "llvm/Passes/PassBuilder.h"
 
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <mutex>
+
 
 llvm::Value * CodeGenerator::generate(const ExpressionPointer expr, llvm::BasicBlock *breakTo = nullptr,
                                       llvm::BasicBlock *exitTo=nullptr) {
@@ -27,6 +44,8 @@ llvm::Value * CodeGenerator::generate(const ExpressionPointer expr, llvm::BasicB
             return std::move(gen_identifier(std::move(std::static_pointer_cast<IdentifierExpression>(expr))));
         case EXPR_BINARY_OPERATION:
             return std::move(gen_binary_operation(std::move(std::static_pointer_cast<BinaryOperationExpression>(expr))));
+        case EXPR_UNARY_OPERATION:
+            return std::move(gen_unary_operation(std::static_pointer_cast<UnaryOperationExpression>(expr)));
         case EXPR_CALL:
             return std::move(gen_call(std::move(std::static_pointer_cast<CallExpression>(expr))));
         case EXPR_FUNCTION:
@@ -34,6 +53,8 @@ llvm::Value * CodeGenerator::generate(const ExpressionPointer expr, llvm::BasicB
         case EXPR_CONDITION:
             return std::move(gen_condition(std::move(std::static_pointer_cast<ConditionExpression>(expr)), breakTo,
                                            exitTo));
+        case EXPR_CASE:
+            return std::move(gen_case(std::static_pointer_cast<CaseExpression>(expr), breakTo, exitTo));
         case EXPR_ASSIGN:
             return std::move(gen_assign(std::move(std::static_pointer_cast<AssignExpression>(expr))));
         case EXPR_WHILE_LOOP:
@@ -62,16 +83,14 @@ llvm::Value* CodeGenerator::gen_integer(const std::shared_ptr<IntegerExpression>
 }
 
 llvm::Value* CodeGenerator::gen_identifier(const std::shared_ptr<IdentifierExpression> expr) {
-    llvm::Value* value;
-    if ((value = m_constants[expr->value()]))
-        return value;
-    if ((value = m_variables[expr->value()]) || ((value = m_globals[expr->value()])))
-        return m_builder->CreateLoad(value, expr->value().c_str());
-
-    throw Exception(expr->position(), "Unknown identifier '" + expr->value() + '\'');
+    return load(expr->value(), expr->position());
 }
 
 llvm::Value* CodeGenerator::gen_binary_operation(const std::shared_ptr<BinaryOperationExpression> expr) {
+    auto opType = expr->op()->type();
+    if ((opType == TOK_AND || opType == TOK_OR) && expr->left()->is_boolean() && expr->right()->is_boolean())
+        return gen_logical(expr);
+
     auto left = generate(expr->left(), nullptr, nullptr);
     auto right = generate(expr->right(), nullptr, nullptr);
 
@@ -81,11 +100,67 @@ llvm::Value* CodeGenerator::gen_binary_operation(const std::shared_ptr<BinaryOpe
     return gen_binary_ints(left, right, expr->op()->type(), std::move(expr->position()));
 }
 
+llvm::Value *CodeGenerator::gen_unary_operation(const std::shared_ptr<UnaryOperationExpression> expr) {
+    auto operand = generate(expr->operand(), nullptr, nullptr);
+    bool isDouble = operand->getType() == m_builder->getDoubleTy();
+    switch (expr->op()) {
+        case TOK_MINUS:
+            if (isDouble)
+                return m_builder->CreateFNeg(operand, "negtmp");
+            return m_builder->CreateNeg(operand, "negtmp");
+        case TOK_NOT:
+            if (isDouble)
+                throw Exception(expr->position(), "Operator 'not' cannot be applied to a double");
+            return m_builder->CreateNot(operand, "nottmp");
+        default:
+            throw Exception(expr->position(), "NOT IMPLEMENTED");
+    }
+}
+
+llvm::Value *CodeGenerator::gen_logical(const std::shared_ptr<BinaryOperationExpression> expr) {
+    bool isAnd = expr->op()->type() == TOK_AND;
+    auto left = generate(expr->left(), nullptr, nullptr);
+
+    // Both sides are cheap - no need to branch
+    if (expr->right()->can_be_speculated()) {
+        auto right = generate(expr->right(), nullptr, nullptr);
+        if (isAnd)
+            return m_builder->CreateSelect(left, right, m_builder->getFalse(), "andtmp");
+        return m_builder->CreateSelect(left, m_builder->getTrue(), right, "ortmp");
+    }
+
+    // Evaluate the right side only if the left one does not decide the result
+    auto function = m_builder->GetInsertBlock()->getParent();
+    auto leftBlock = m_builder->GetInsertBlock();
+    auto rightBlock = llvm::BasicBlock::Create(m_context, isAnd ? "and_rhs" : "or_rhs", function);
+    auto mergeBlock = llvm::BasicBlock::Create(m_context, isAnd ? "and_end" : "or_end");
+    if (isAnd)
+        m_builder->CreateCondBr(left, rightBlock, mergeBlock);
+    else
+        m_builder->CreateCondBr(left, mergeBlock, rightBlock);
+    seal_block(rightBlock);
+
+    m_builder->SetInsertPoint(rightBlock);
+    auto right = generate(expr->right(), nullptr, nullptr);
+    rightBlock = m_builder->GetInsertBlock();
+    m_builder->CreateBr(mergeBlock);
+    seal_block(mergeBlock);
+
+    function->getBasicBlockList().push_back(mergeBlock);
+    m_builder->SetInsertPoint(mergeBlock);
+    auto phi = m_builder->CreatePHI(m_builder->getInt1Ty(), 2, isAnd ? "andtmp" : "ortmp");
+    phi->addIncoming(isAnd ? m_builder->getFalse() : m_builder->getTrue(), leftBlock);
+    phi->addIncoming(right, rightBlock);
+    return phi;
+}
+
 llvm::Value* CodeGenerator::gen_call(const std::shared_ptr<CallExpression> expr) {
     auto function = m_module->getFunction(expr->name());
+    // write and writeln pick the helper by the type of their argument, which is generated only once
+    llvm::Value* written = nullptr;
     if (expr->args().size() == 1) {
         if (expr->name() == "write") {
-            auto arg = generate(*expr->args().cbegin());
+            auto arg = written = generate(*expr->args().cbegin());
             if (arg->getType() == get_type(TOK_INTEGER))
                 function = m_module->getFunction("writeInt");
             else if (arg->getType() == get_type(TOK_DOUBLE))
@@ -95,7 +170,7 @@ llvm::Value* CodeGenerator::gen_call(const std::shared_ptr<CallExpression> expr)
                 return m_builder->CreateCall(function, arg, "calltmp");
             }
         } else if (expr->name() == "writeln") {
-            auto arg = generate(*expr->args().cbegin());
+            auto arg = written = generate(*expr->args().cbegin());
             if (arg->getType() == get_type(TOK_INTEGER))
                 function = m_module->getFunction("writeLnInt");
             else if (arg->getType() == get_type(TOK_DOUBLE))
@@ -133,6 +208,8 @@ llvm::Value* CodeGenerator::gen_call(const std::shared_ptr<CallExpression> expr)
         if (arg->type() == EXPR_IDENTIFIER) {
             auto ident = std::static_pointer_cast<IdentifierExpression>(arg);
             llvm::Value* value;
+            if (m_loopCounters.count(ident->value()))
+                throw Exception(arg->position(), "Cannot read to for-loop counter");
             if ((value = m_variables[ident->value()]) || (value = m_globals[ident->value()]))
                 args.push_back(value);
             else {
@@ -142,7 +219,9 @@ llvm::Value* CodeGenerator::gen_call(const std::shared_ptr<CallExpression> expr)
             }
         } else
             throw Exception(arg->position(), "Can only read into a variable");
-    } else {
+    } else if (written)
+        args.push_back(written);
+    else {
         for (const auto &arg : expr->args())
             args.push_back(generate(arg));
     }
@@ -177,7 +256,7 @@ llvm::Constant * CodeGenerator::get_default_value(TokenType type) {
     }
 }
 
-llvm::Value* CodeGenerator::gen_function(const std::shared_ptr<FunctionExpression> expr) {
+llvm::Function* CodeGenerator::declare_function(const std::shared_ptr<FunctionExpression> expr) {
     // Function type
     std::vector<llvm::Type *> argTypes;
     for (auto &tt : expr->arg_types())
@@ -185,17 +264,17 @@ llvm::Value* CodeGenerator::gen_function(const std::shared_ptr<FunctionExpressio
     auto retType = get_type(expr->return_type());
     auto functionType = llvm::FunctionType::get(retType, argTypes, false);
     auto function = m_module->getFunction(expr->name());
-    bool writeBody = false;
     if (function) {
         if (function->getFunctionType() != functionType)
             throw Exception(std::move(expr->position()), "Function redefinition: " + expr->name());
-        writeBody = true;
-    } else {
-        function = llvm::Function::Create(
-                functionType, llvm::Function::ExternalLinkage, expr->name(), m_module.get());
+        return function;
     }
-        if (expr->body())
-            writeBody = true;
+    return llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, expr->name(), m_module.get());
+}
+
+llvm::Value* CodeGenerator::gen_function(const std::shared_ptr<FunctionExpression> expr) {
+    auto function = declare_function(expr);
+    bool writeBody = expr->body() != nullptr;
     auto argNames = expr->arg_names();
     size_t i = 0;
     for (auto &arg : function->args())
@@ -203,38 +282,73 @@ llvm::Value* CodeGenerator::gen_function(const std::shared_ptr<FunctionExpressio
     // Vars and consts
     if (writeBody) {
         auto body = llvm::BasicBlock::Create(m_context, "entry", function);
+        seal_block(body);
         m_builder->SetInsertPoint(body);
-        for (auto& arg : function->args()) {
-            auto alloca = create_alloca(function, arg.getName(), arg.getType());
-            m_builder->CreateStore(&arg, alloca);
-            m_variables[std::string(arg.getName())] = alloca;
-        }
+
+        // In SSA mode only variables passed to readln need memory
+        std::set<std::string> inMemory;
+        if (m_options.ssa)
+            collect_read_targets(expr->body(), inMemory);
+        auto declare = [&](const std::string& name, llvm::Type* type, llvm::Value* initial) {
+            if (m_options.ssa && !inMemory.count(name)) {
+                m_ssaVariables[name] = type;
+                write_variable(name, body, initial ? initial : llvm::Constant::getNullValue(type));
+                return;
+            }
+            auto alloca = create_alloca(function, name, type);
+            m_builder->CreateStore(initial ? initial : llvm::Constant::getNullValue(type), alloca);
+            m_variables[name] = alloca;
+        };
+
+        for (auto& arg : function->args())
+            declare(std::string(arg.getName()), arg.getType(), &arg);
         auto oldConsts = m_constants;
         for (auto& c : expr->consts())
             m_constants[c.first] =
                     llvm::dyn_cast<llvm::ConstantInt>(generate(c.second, nullptr, nullptr));//create_alloca(function, c.first, llvm::Type::getInt32Ty(m_context));
 
         auto oldVars = m_variables;
+        m_locals.clear();
         for (auto& v : expr->vars())
-            m_variables[v.first] = create_alloca(function, v.first, get_type(v.second));
+            m_locals.emplace_back(v.first, get_type(v.second));
         if (expr->return_type() != TOK_VOID)
-            m_variables[expr->name()] = create_alloca(function, expr->name(), get_type(expr->return_type()));
+            m_locals.emplace_back(expr->name(), get_type(expr->return_type()));
+        for (const auto& local : m_locals)
+            declare(local.first, local.second, nullptr);
 
+        // Calls whose result is returned right away
+        m_function = expr;
+        m_tailCalls.clear();
+        if (expr->return_type() != TOK_VOID)
+            collect_tail_calls(expr->body(), true);
+        // Self-recursive tail calls jump here
+        m_tailCallBlock = llvm::BasicBlock::Create(m_context, "tailrecurse", function);
+        m_builder->SetInsertPoint(body);
+        m_builder->CreateBr(m_tailCallBlock);
 
     // body
         auto retBlock = llvm::BasicBlock::Create(m_context, "return", function);
-        m_builder->SetInsertPoint(body);
+        m_builder->SetInsertPoint(m_tailCallBlock);
 
         generate(expr->body(), nullptr, retBlock);
         m_builder->CreateBr(retBlock);
+        seal_block(m_tailCallBlock);
+        seal_block(retBlock);
         m_builder->SetInsertPoint(retBlock);
 
-        auto retVal = expr->return_type() == TOK_VOID ? nullptr : m_builder->CreateLoad(m_variables[expr->name()]);
+        auto retVal = expr->return_type() == TOK_VOID ? nullptr : load(expr->name(), expr->position());
 
         m_builder->CreateRet(retVal);
         m_constants = oldConsts;
+        m_tailCalls.clear();
+        m_locals.clear();
+        m_function = nullptr;
     }
     m_variables.clear();
+    m_ssaVariables.clear();
+    m_currentDef.clear();
+    m_incompletePhis.clear();
+    m_sealedBlocks.clear();
 
     return function;
 }
@@ -258,6 +372,8 @@ llvm::Value *CodeGenerator::gen_while(const std::shared_ptr<WhileLoopExpression>
     generate(expr->body(), afterBlock, exitTo);
     condValue = generate(expr->condition(), nullptr, nullptr);
     m_builder->CreateCondBr(condValue, goBlock, afterBlock);
+    seal_block(goBlock);
+    seal_block(afterBlock);
     function->getBasicBlockList().push_back(afterBlock);
     m_builder->SetInsertPoint(afterBlock);
     return function;
@@ -275,6 +391,8 @@ llvm::Value * CodeGenerator::gen_condition(const std::shared_ptr<ConditionExpres
     auto mergeBlock = llvm::BasicBlock::Create(m_context, "ifcont");
     // split
     m_builder->CreateCondBr(condValue, thenBlock, elseBlock);
+    seal_block(thenBlock);
+    seal_block(elseBlock);
     // then
     m_builder->SetInsertPoint(thenBlock);
     generate(expr->thenBody(), breakTo, exitTo);
@@ -286,38 +404,262 @@ llvm::Value * CodeGenerator::gen_condition(const std::shared_ptr<ConditionExpres
     if (expr->elseBody())
         generate(expr->elseBody(), breakTo, exitTo);
     m_builder->CreateBr(mergeBlock);
+    seal_block(mergeBlock);
     // merge
     function->getBasicBlockList().push_back(mergeBlock);
     m_builder->SetInsertPoint(mergeBlock);
     return function;
 }
 
+void CodeGenerator::collect_tail_calls(const ExpressionPointer expr, bool tail) {
+    if (!expr)
+        return;
+    switch (expr->type()) {
+        case EXPR_ASSIGN: {
+            // function := call(...) right before returning
+            auto assign = std::static_pointer_cast<AssignExpression>(expr);
+            if (tail && assign->name() == m_function->name() && assign->value()->type() == EXPR_CALL)
+                m_tailCalls.insert(expr.get());
+            break;
+        }
+        case EXPR_BLOCK: {
+            auto body = std::static_pointer_cast<BlockExpression>(expr)->body();
+            for (auto it = body.begin(); it != body.end(); it++) {
+                auto next = std::next(it);
+                bool last = next == body.end();
+                collect_tail_calls(*it, (last && tail) || (!last && (*next)->type() == EXPR_EXIT));
+            }
+            break;
+        }
+        case EXPR_CONDITION: {
+            auto condition = std::static_pointer_cast<ConditionExpression>(expr);
+            collect_tail_calls(condition->thenBody(), tail);
+            collect_tail_calls(condition->elseBody(), tail);
+            break;
+        }
+        case EXPR_CASE: {
+            auto caseExpr = std::static_pointer_cast<CaseExpression>(expr);
+            for (const auto& branch : caseExpr->branches())
+                collect_tail_calls(branch.body, tail);
+            collect_tail_calls(caseExpr->otherwise(), tail);
+            break;
+        }
+        // a loop body can end with 'exit', but never falls through to the return
+        case EXPR_WHILE_LOOP:
+            collect_tail_calls(std::static_pointer_cast<WhileLoopExpression>(expr)->body(), false);
+            break;
+        case EXPR_FOR_LOOP:
+            collect_tail_calls(std::static_pointer_cast<ForLoopExpression>(expr)->body(), false);
+            break;
+        default:
+            break;
+    }
+}
+
+llvm::Value *CodeGenerator::gen_tail_call(const std::shared_ptr<CallExpression> expr) {
+    auto caller = m_builder->GetInsertBlock()->getParent();
+    auto callee = m_module->getFunction(expr->name());
+    if (!callee || expr->number_of_args() != callee->arg_size())
+        return nullptr;     // let gen_call report it
+
+    // Self-recursion: rebind the arguments and jump back to the top
+    if (callee == caller) {
+        std::vector<llvm::Value *> args;
+        for (const auto &arg : expr->args())
+            args.push_back(generate(arg));
+        auto argNames = m_function->arg_names();
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i]->getType() != caller->getArg(i)->getType())
+                throw Exception(expr->position(), "Argument " + std::to_string(i + 1) + " has a wrong type");
+            assign(argNames[i], args[i], expr->position());
+        }
+        // A new call starts with fresh locals, as the entry block gives them
+        for (const auto& local : m_locals)
+            assign(local.first, llvm::Constant::getNullValue(local.second), expr->position());
+        auto branch = m_builder->CreateBr(m_tailCallBlock);
+        continue_unreachable();
+        return branch;
+    }
+
+    // Other functions: musttail requires identical prototypes
+    if (callee->getFunctionType() != caller->getFunctionType()) {
+        warning(expr->position(), "Call to '" + expr->name() + "' in tail position is not a tail call: "
+                                  "its signature differs from '" + m_function->name() + '\'');
+        return nullptr;
+    }
+    auto call = llvm::cast<llvm::CallInst>(gen_call(expr));
+    call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    auto ret = m_builder->CreateRet(call);
+    continue_unreachable();
+    return ret;
+}
+
+void CodeGenerator::warning(TextPosition position, std::string message) {
+    m_warnings.emplace_back(std::move(position), std::move(message));
+}
+
+llvm::Value *CodeGenerator::gen_case(const std::shared_ptr<CaseExpression> expr, llvm::BasicBlock *breakTo,
+                                     llvm::BasicBlock *exitTo) {
+    // Ranges up to this size become individual switch cases, wider ones are compared explicitly
+    static const int64_t maxExpandedRange = 64;
+
+    auto selector = generate(expr->selector(), nullptr, nullptr);
+    if (selector->getType() != m_builder->getInt32Ty())
+        throw Exception(expr->selector()->position(), "Case selector must be an integer");
+
+    auto function = m_builder->GetInsertBlock()->getParent();
+    auto elseBlock = llvm::BasicBlock::Create(m_context, "case_else");
+    auto mergeBlock = llvm::BasicBlock::Create(m_context, "case_end");
+    auto switchInst = m_builder->CreateSwitch(selector, elseBlock, expr->branches().size());
+
+    std::map<int64_t, int64_t> covered;    // low -> high, for overlap detection
+    std::list<std::tuple<llvm::ConstantInt*, llvm::ConstantInt*, llvm::BasicBlock*>> wideRanges;
+    std::vector<llvm::BasicBlock*> caseBlocks;
+    for (const auto& branch : expr->branches()) {
+        auto caseBlock = llvm::BasicBlock::Create(m_context, "case", function);
+        caseBlocks.push_back(caseBlock);
+        for (const auto& label : branch.labels) {
+            auto low = case_label(label.first);
+            auto high = label.second ? case_label(label.second) : low;
+            auto lowValue = low->getSExtValue(), highValue = high->getSExtValue();
+            if (lowValue > highValue)
+                throw Exception(label.first->position(), "Empty case range");
+            auto next = covered.upper_bound(lowValue);
+            if ((next != covered.end() && next->first <= highValue)
+                    || (next != covered.begin() && std::prev(next)->second >= lowValue))
+                throw Exception(label.first->position(), "Duplicate case label");
+            covered[lowValue] = highValue;
+
+            if (highValue - lowValue < maxExpandedRange)
+                for (auto value = lowValue; value <= highValue; value++)
+                    switchInst->addCase(m_builder->getInt32(value), caseBlock);
+            else
+                wideRanges.emplace_back(low, high, caseBlock);
+        }
+    }
+
+    // else: wide ranges first, then the else-branch itself
+    function->getBasicBlockList().push_back(elseBlock);
+    seal_block(elseBlock);
+    m_builder->SetInsertPoint(elseBlock);
+    for (const auto& range : wideRanges) {
+        auto offset = m_builder->CreateSub(selector, std::get<0>(range), "caseoffset");
+        auto width = llvm::ConstantExpr::getSub(std::get<1>(range), std::get<0>(range));
+        auto inRange = m_builder->CreateICmpULE(offset, width, "inrange");
+        auto nextBlock = llvm::BasicBlock::Create(m_context, "case_else", function);
+        m_builder->CreateCondBr(inRange, std::get<2>(range), nextBlock);
+        seal_block(nextBlock);
+        m_builder->SetInsertPoint(nextBlock);
+    }
+    if (expr->otherwise())
+        generate(expr->otherwise(), breakTo, exitTo);
+    m_builder->CreateBr(mergeBlock);
+
+    // All jumps into the branches are known now
+    auto caseBlock = caseBlocks.begin();
+    for (const auto& branch : expr->branches()) {
+        seal_block(*caseBlock);
+        m_builder->SetInsertPoint(*caseBlock++);
+        if (branch.body)
+            generate(branch.body, breakTo, exitTo);
+        m_builder->CreateBr(mergeBlock);
+    }
+    seal_block(mergeBlock);
+
+    function->getBasicBlockList().push_back(mergeBlock);
+    m_builder->SetInsertPoint(mergeBlock);
+    return function;
+}
+
+llvm::ConstantInt *CodeGenerator::case_label(const ExpressionPointer expr) {
+    auto value = llvm::dyn_cast<llvm::ConstantInt>(generate(expr, nullptr, nullptr));
+    if (!value || value->getType() != m_builder->getInt32Ty())
+        throw Exception(expr->position(), "Case label must be an integer constant");
+    return value;
+}
+
 llvm::Value* CodeGenerator::gen_assign(const std::shared_ptr<AssignExpression> expr) {
+    if (m_tailCalls.count(expr.get()))
+        if (auto result = gen_tail_call(std::static_pointer_cast<CallExpression>(expr->value())))
+            return result;
     return assign(std::move(expr->name()), generate(std::move(expr->value()), nullptr, nullptr), expr->position());
 }
 
 
-void CodeGenerator::print() const {
-    m_module->print(llvm::errs(), nullptr);
+void CodeGenerator::print(llvm::raw_ostream& stream) const {
+    m_module->print(stream, nullptr);
+}
+
+llvm::orc::ThreadSafeModule CodeGenerator::take_module() {
+    return llvm::orc::ThreadSafeModule(std::move(m_module), m_threadSafeContext);
 }
 
 llvm::Value *CodeGenerator::generate_code() {
+    declare_globals(true);
+    for (const auto& fun : m_tree->functions())
+        gen_function(fun);
+    return gen_main();
+}
+
+llvm::Value *CodeGenerator::generate_main() {
+    declare_globals(true);
+    for (const auto& fun : m_tree->functions())
+        declare_function(fun);
+    return gen_main();
+}
+
+llvm::Value *CodeGenerator::generate_function(const std::string& name) {
+    // Globals and the other functions live elsewhere
+    declare_globals(false);
+    std::shared_ptr<FunctionExpression> definition;
+    for (const auto& fun : m_tree->functions()) {
+        declare_function(fun);
+        if (fun->name() == name && fun->body())
+            definition = fun;
+    }
+    if (!definition)
+        throw Exception("Function is not defined: " + name);
+    return gen_function(definition);
+}
+
+llvm::Value *CodeGenerator::generate_unit() {
+    auto unit = std::dynamic_pointer_cast<UnitExpression>(m_tree);
+    if (!unit)
+        throw Exception("Not a unit");
+    declare_globals(true);
+    for (const auto& fun : m_tree->functions())
+        gen_function(fun);
+
+    // What the interface does not mention stays private to the unit
+    for (auto& global : m_module->globals())
+        if (!global.isDeclaration() && !unit->exports().count(global.getName().str()))
+            global.setLinkage(llvm::GlobalValue::InternalLinkage);
+    for (const auto& fun : m_tree->functions())
+        if (fun->body() && !unit->exports().count(fun->name()))
+            m_module->getFunction(fun->name())->setLinkage(llvm::GlobalValue::InternalLinkage);
+    return nullptr;
+}
+
+void CodeGenerator::declare_globals(bool define) {
     for (auto& c : m_tree->consts())
         m_constants[c.first] = llvm::dyn_cast<llvm::Constant>(generate(c.second, nullptr, nullptr));
     for (auto& v : m_tree->vars()) {
         auto global = new llvm::GlobalVariable(
                 *m_module, get_type(v.second), false, llvm::GlobalVariable::ExternalLinkage,
-                get_default_value(v.second), v.first);
+                define ? get_default_value(v.second) : nullptr, v.first);
         m_globals[v.first] = global;
     }
+    for (auto& v : m_tree->externals())
+        m_globals[v.first] = new llvm::GlobalVariable(*m_module, get_type(v.second), false,
+                                                      llvm::GlobalVariable::ExternalLinkage, nullptr, v.first);
     auto global = new llvm::GlobalVariable(*m_module, get_type(TOK_INTEGER), false,
-                                           llvm::GlobalVariable::ExternalLinkage, m_builder->getInt32(0), "_extra");
+                                           llvm::GlobalVariable::ExternalLinkage,
+                                           define ? m_builder->getInt32(0) : nullptr, "_extra");
     m_globals["_extra"] = global;
+}
 
-    for (const auto& fun : m_tree->functions())
-        gen_function(fun);
-
-    auto fType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_context), {}, false);
+llvm::Value *CodeGenerator::gen_main() {
+    auto fType = llvm::FunctionType::get(llvm::Type::getInt32Ty(m_context), {}, false);
     auto function = llvm::Function::Create(fType, llvm::Function::ExternalLinkage, "main", m_module.get());
     auto body = llvm::BasicBlock::Create(m_context, "start", function);
     m_builder->SetInsertPoint(body);
@@ -325,7 +667,7 @@ llvm::Value *CodeGenerator::generate_code() {
     gen_block(m_tree->body(), nullptr, exitBlock);
     m_builder->CreateBr(exitBlock);
     m_builder->SetInsertPoint(exitBlock);
-    m_builder->CreateRet(nullptr);
+    m_builder->CreateRet(m_builder->getInt32(0));
     return function;
 }
 
@@ -336,16 +678,33 @@ llvm::Value *CodeGenerator::gen_block(const std::shared_ptr<BlockExpression> exp
     return nullptr;
 }
 
-void CodeGenerator::write_output(const char *fileName) {
-    // Initialize the target registry etc
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+void CodeGenerator::initialize_targets() {
+    // Code is only ever generated for the host, so that is the one target registered. Once,
+    // units may be compiled on several threads
+    static std::once_flag targetsInitialized;
+    std::call_once(targetsInitialized, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
+
+llvm::TargetMachine *CodeGenerator::target_machine() {
+    if (m_targetMachine)
+        return m_targetMachine.get();
 
+    initialize_targets();
+
+    m_module->setTargetTriple(llvm::sys::getDefaultTargetTriple());
+    m_targetMachine = create_target_machine();
+
+    m_module->setDataLayout(m_targetMachine->createDataLayout());
+    return m_targetMachine.get();
+}
+
+// Safe to call from several threads once target_machine() has set up the registry
+std::unique_ptr<llvm::TargetMachine> CodeGenerator::create_target_machine() const {
     auto targetTriple = llvm::sys::getDefaultTargetTriple();
-    m_module->setTargetTriple(targetTriple);
 
     std::string error;
     auto target = llvm::TargetRegistry::lookupTarget(targetTriple, error);
@@ -353,168 +712,498 @@ void CodeGenerator::write_output(const char *fileName) {
     if (!target)
         throw Exception(error);
 
-    auto cpu = "generic";
-    auto features = "";
+    auto cpu = target_cpu();
+    auto features = target_features();
+
+    llvm::CodeGenOpt::Level codeGenLevel;
+    switch (m_options.optLevel) {
+        case OPT_0: codeGenLevel = llvm::CodeGenOpt::None; break;
+        case OPT_1: codeGenLevel = llvm::CodeGenOpt::Less; break;
+        case OPT_3: codeGenLevel = llvm::CodeGenOpt::Aggressive; break;
+        default: codeGenLevel = llvm::CodeGenOpt::Default; break;
+    }
 
     llvm::TargetOptions opt;
     auto relocModel = llvm::Optional<llvm::Reloc::Model>();
-    auto targetMachine = target->createTargetMachine(targetTriple, cpu, features, opt, relocModel);
-
-    m_module->setDataLayout(targetMachine->createDataLayout());
-
-    std::error_code errorCode;
-    llvm::raw_fd_ostream dest(fileName, errorCode, llvm::sys::fs::OF_None);
-
-    if (errorCode)
-        throw Exception(errorCode.message());
+    // Units are also loaded by the JIT, anywhere in the address space
+    if (std::dynamic_pointer_cast<UnitExpression>(m_tree))
+        relocModel = llvm::Reloc::PIC_;
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(targetTriple, cpu, features, opt,
+                                                                            relocModel, llvm::None, codeGenLevel));
+}
 
-    llvm::legacy::PassManager pass;
+std::string CodeGenerator::target_cpu() const {
+    if (m_options.cpu == "native")
+        return llvm::sys::getHostCPUName().str();
+    return m_options.cpu;
+}
 
-    auto fileType = llvm::CGFT_ObjectFile;
+std::string CodeGenerator::target_features() const {
+    std::string features;
+    if (m_options.cpu == "native") {
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures))
+            for (const auto& feature : hostFeatures)
+                features += (features.empty() ? "" : ",") + std::string(feature.second ? "+" : "-")
+                            + feature.first().str();
+    }
+    // Explicit ones go last to take precedence
+    if (!m_options.features.empty())
+        features += (features.empty() ? "" : ",") + m_options.features;
+    return features;
+}
 
-    if (targetMachine->addPassesToEmitFile(pass, dest, nullptr, fileType))
-        throw Exception("I don't want to do that");
+void CodeGenerator::optimize() {
+    std::string problems;
+    llvm::raw_string_ostream problemStream(problems);
+    if (llvm::verifyModule(*m_module, &problemStream))
+        throw Exception("Generated code is invalid: " + problemStream.str());
+    link_runtime();
+
+    // Let the IR passes see the same target as the backend
+    auto cpu = target_cpu(), features = target_features();
+    for (auto& function : *m_module) {
+        if (function.isDeclaration())
+            continue;
+        function.addFnAttr("target-cpu", cpu);
+        if (!features.empty())
+            function.addFnAttr("target-features", features);
+    }
+    multiversion();
+    if (m_options.wholeProgram && !m_options.lazy)
+        internalize();
+    if (m_options.optLevel == OPT_0)
+        return;
+
+    llvm::OptimizationLevel level = llvm::OptimizationLevel::O2;
+    switch (m_options.optLevel) {
+        case OPT_1: level = llvm::OptimizationLevel::O1; break;
+        case OPT_3: level = llvm::OptimizationLevel::O3; break;
+        case OPT_SIZE: level = llvm::OptimizationLevel::Os; break;
+        case OPT_MIN_SIZE: level = llvm::OptimizationLevel::Oz; break;
+        default: break;
+    }
+    // The size levels also rely on per-function attributes
+    for (auto& function : *m_module) {
+        if (function.isDeclaration())
+            continue;
+        if (level.getSizeLevel() > 0)
+            function.addFnAttr(llvm::Attribute::OptimizeForSize);
+        if (level.getSizeLevel() > 1)
+            function.addFnAttr(llvm::Attribute::MinSize);
+    }
 
-    pass.run(*m_module);
+    llvm::LoopAnalysisManager loopAnalysis;
+    llvm::FunctionAnalysisManager functionAnalysis;
+    llvm::CGSCCAnalysisManager cgsccAnalysis;
+    llvm::ModuleAnalysisManager moduleAnalysis;
 
-    dest.flush();
+    llvm::PassBuilder passBuilder(target_machine());
+    passBuilder.registerModuleAnalyses(moduleAnalysis);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysis);
+    passBuilder.registerFunctionAnalyses(functionAnalysis);
+    passBuilder.registerLoopAnalyses(loopAnalysis);
+    passBuilder.crossRegisterProxies(loopAnalysis, functionAnalysis, cgsccAnalysis, moduleAnalysis);
 
-    std::system((std::string("clang ") + fileName + " -o " + fileName + ".bin").c_str());
+    auto passes = passBuilder.buildPerModuleDefaultPipeline(level);
+    passes.run(*m_module, moduleAnalysis);
 }
 
-void CodeGenerator::add_standard_functions() {
-    // printf
-    auto printfType = llvm::FunctionType::get(llvm::Type::getInt32Ty(m_context),
-            {llvm::Type::getInt8PtrTy(m_context)}, true);
-    auto printfFun = llvm::Function::Create(printfType, llvm::Function::ExternalLinkage,
-            "printf", m_module.get());
-
-    {
-        auto writeIntType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_context),
-                                                    {llvm::Type::getInt32Ty(m_context)}, false);
-        // write(int)
-        {
-            auto writeIntFun = llvm::Function::Create(writeIntType, llvm::Function::ExternalLinkage,
-                                                      "writeInt", m_module.get());
-            auto writeIntBlk = llvm::BasicBlock::Create(m_context, "start", writeIntFun);
-            m_builder->SetInsertPoint(writeIntBlk);
-            llvm::Value *writeIntStr = m_builder->CreateGlobalStringPtr("%d");
-            m_builder->CreateCall(printfType, printfFun, {writeIntStr, writeIntFun->getArg(0)});
-            m_builder->CreateRet(nullptr);
-        }
+void CodeGenerator::multiversion() {
+    if (m_options.multiversion.empty())
+        return;
+    if (m_options.run) {
+        // The JIT already compiles for the machine it runs on
+        warning({0, 0}, "Function multiversioning is ignored with --run");
+        return;
+    }
+    llvm::Triple triple(target_machine()->getTargetTriple());
+    if (triple.getArch() != llvm::Triple::x86_64 || !triple.isOSBinFormatELF()) {
+        warning({0, 0}, "Function multiversioning is only supported on x86-64 ELF targets");
+        return;
+    }
 
-        // writeln(int)
-        {
-            auto writeIntFun = llvm::Function::Create(writeIntType, llvm::Function::ExternalLinkage,
-                                                      "writeLnInt", m_module.get());
-            auto writeIntBlk = llvm::BasicBlock::Create(m_context, "start", writeIntFun);
-            m_builder->SetInsertPoint(writeIntBlk);
-            llvm::Value *writeIntStr = m_builder->CreateGlobalStringPtr("%d\n");
-            m_builder->CreateCall(printfType, printfFun, {writeIntStr, writeIntFun->getArg(0)});
-            m_builder->CreateRet(nullptr);
+    // Bits of __cpu_model.__cpu_features as filled in by libgcc / compiler-rt
+    const uint32_t x86_64_v3 = 1u << 10 | 1u << 14 | 1u << 16 | 1u << 17;                   // AVX2 FMA BMI BMI2
+    const uint32_t x86_64_v4 = x86_64_v3 | 1u << 15 | 1u << 20 | 1u << 21 | 1u << 22 | 1u << 23;   // AVX-512 F VL BW DQ CD
+    // The rest of x86-64-v3 is not in __cpu_features, where it is depends on the libgcc version,
+    // so cpuid is asked: F16C and MOVBE in leaf 1 ECX, LZCNT in leaf 0x80000001 ECX
+    const uint32_t leaf1 = 1u << 29 | 1u << 22, leafExtended1 = 1u << 5;
+    const char* v3Features = "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave";
+    // Most capable first, the original function is the fallback. A clone gets the features of its
+    // level instead of the baseline's, which may lack some or have more
+    const struct { const char* suffix; const char* cpu; std::string targetFeatures; uint32_t features; } versions[] = {
+            {"avx512", "x86-64-v4", std::string(v3Features) + ",+avx512f,+avx512vl,+avx512bw,+avx512dq,+avx512cd",
+             x86_64_v4},
+            {"avx2", "x86-64-v3", v3Features, x86_64_v3}
+    };
+
+    std::set<std::string> selected;
+    std::istringstream names(m_options.multiversion);
+    for (std::string name; std::getline(names, name, ',');)
+        selected.insert(name);
+    bool automatic = selected.count("auto");
+
+    std::list<llvm::Function*> functions;
+    for (const auto& fun : m_tree->functions()) {
+        auto function = m_module->getFunction(fun->name());
+        if (!function || function->isDeclaration())
+            continue;
+        if (selected.erase(fun->name())) {
+            functions.push_back(function);
+        } else if (automatic) {
+            // Only functions with loops are worth it
+            llvm::SmallVector<std::pair<const llvm::BasicBlock*, const llvm::BasicBlock*>, 4> backEdges;
+            llvm::FindFunctionBackedges(*function, backEdges);
+            if (!backEdges.empty())
+                functions.push_back(function);
         }
     }
-
-    {
-        auto writeDoubleType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_context),
-                                                       {llvm::Type::getDoubleTy(m_context)}, false);
-        // write(double)
-        {
-            auto writeDoubleFun = llvm::Function::Create(writeDoubleType, llvm::Function::ExternalLinkage,
-                                                         "writeDouble", m_module.get());
-            auto writeDoubleBlk = llvm::BasicBlock::Create(m_context, "start", writeDoubleFun);
-            m_builder->SetInsertPoint(writeDoubleBlk);
-            llvm::Value *writeDoubleStr = m_builder->CreateGlobalStringPtr("%lf");
-            m_builder->CreateCall(printfType, printfFun, {writeDoubleStr, writeDoubleFun->getArg(0)});
-            m_builder->CreateRet(nullptr);
+    selected.erase("auto");
+    for (const auto& name : selected)
+        warning({0, 0}, "Cannot multiversion unknown function '" + name + '\'');
+
+    auto cpuModelType = llvm::StructType::get(m_context, {m_builder->getInt32Ty(), m_builder->getInt32Ty(),
+                                                          m_builder->getInt32Ty(),
+                                                          llvm::ArrayType::get(m_builder->getInt32Ty(), 1)});
+    auto cpuModel = m_module->getOrInsertGlobal("__cpu_model", cpuModelType);
+    auto cpuInit = m_module->getOrInsertFunction("__cpu_indicator_init",
+                                                 llvm::FunctionType::get(m_builder->getVoidTy(), false));
+
+    for (auto function : functions) {
+        std::string name = function->getName().str();
+        function->setName(name + ".default");
+        function->setLinkage(llvm::Function::InternalLinkage);
+
+        // The dispatcher takes over the name and every outside use
+        auto resolverType = llvm::FunctionType::get(function->getType(), false);
+        auto resolver = llvm::Function::Create(resolverType, llvm::Function::InternalLinkage, name + ".resolver",
+                                               m_module.get());
+        auto dispatch = llvm::GlobalIFunc::create(function->getFunctionType(), 0, llvm::Function::ExternalLinkage,
+                                                  name, resolver, m_module.get());
+        function->replaceUsesWithIf(dispatch, [function](llvm::Use& use) {
+            auto inst = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+            return !inst || inst->getFunction() != function;
+        });
+
+        // Resolved once by the dynamic loader, before constructors run
+        llvm::IRBuilder<> builder(llvm::BasicBlock::Create(m_context, "entry", resolver));
+        builder.CreateCall(cpuInit);
+        auto featuresPtr = builder.CreateConstInBoundsGEP2_32(cpuModelType, cpuModel, 3, 0);
+        auto features = builder.CreateLoad(builder.getInt32Ty(), featuresPtr, "features");
+        auto cpuid = [&builder](uint32_t leaf) {
+            auto type = llvm::FunctionType::get(llvm::StructType::get(builder.getInt32Ty(), builder.getInt32Ty(),
+                                                                      builder.getInt32Ty(), builder.getInt32Ty()),
+                                                {builder.getInt32Ty(), builder.getInt32Ty()}, false);
+            auto instruction = llvm::InlineAsm::get(type, "cpuid", "={ax},={bx},={cx},={dx},{ax},{cx},"
+                                                                   "~{dirflag},~{fpsr},~{flags}", false);
+            return builder.CreateExtractValue(builder.CreateCall(type, instruction, {builder.getInt32(leaf),
+                                                                                     builder.getInt32(0)}), 2);
+        };
+        auto hasMask = [&builder](llvm::Value* bits, uint32_t mask, const llvm::Twine& name) {
+            return builder.CreateICmpEQ(builder.CreateAnd(bits, builder.getInt32(mask)), builder.getInt32(mask), name);
+        };
+        auto restOfV3 = builder.CreateAnd(hasMask(cpuid(1), leaf1, "leaf1"),
+                                          hasMask(cpuid(0x80000001), leafExtended1, "leaf80000001"), "v3rest");
+        for (const auto& version : versions) {
+            auto clone = llvm::Function::Create(function->getFunctionType(), llvm::Function::InternalLinkage,
+                                                name + '.' + version.suffix, m_module.get());
+            llvm::ValueToValueMapTy valueMap;
+            auto cloneArg = clone->arg_begin();
+            for (auto& arg : function->args())
+                valueMap[&arg] = &*cloneArg++;
+            valueMap[function] = clone;     // recursion stays within the version
+            llvm::SmallVector<llvm::ReturnInst*, 4> returns;
+            llvm::CloneFunctionInto(clone, function, valueMap, llvm::CloneFunctionChangeType::LocalChangesOnly,
+                                    returns);
+            clone->addFnAttr("target-cpu", version.cpu);
+            clone->addFnAttr("target-features", version.targetFeatures);
+
+            auto supported = builder.CreateAnd(hasMask(features, version.features, ""), restOfV3, version.suffix);
+            auto useBlock = llvm::BasicBlock::Create(m_context, version.suffix, resolver);
+            auto nextBlock = llvm::BasicBlock::Create(m_context, "next", resolver);
+            builder.CreateCondBr(supported, useBlock, nextBlock);
+            builder.SetInsertPoint(useBlock);
+            builder.CreateRet(clone);
+            builder.SetInsertPoint(nextBlock);
         }
+        builder.CreateRet(function);
+    }
+}
 
-        // writeln(double)
-        {
-            auto writeDoubleFun = llvm::Function::Create(writeDoubleType, llvm::Function::ExternalLinkage,
-                                                         "writeLnDouble", m_module.get());
-            auto writeDoubleBlk = llvm::BasicBlock::Create(m_context, "start", writeDoubleFun);
-            m_builder->SetInsertPoint(writeDoubleBlk);
-            llvm::Value *writeDoubleStr = m_builder->CreateGlobalStringPtr("%lf\n");
-            m_builder->CreateCall(printfType, printfFun, {writeDoubleStr, writeDoubleFun->getArg(0)});
-            m_builder->CreateRet(nullptr);
-        }
+void CodeGenerator::internalize() {
+    auto main = m_module->getFunction("main");
+
+    // Only main has to stay visible
+    for (auto& global : m_module->global_values())
+        if (&global != main && !global.isDeclaration() && !global.hasLocalLinkage())
+            global.setLinkage(llvm::GlobalValue::InternalLinkage);
+
+    // fastcc for functions that are only ever called directly
+    std::set<llvm::Function*> fast;
+    for (auto& function : *m_module) {
+        if (&function == main || function.isDeclaration())
+            continue;
+        if (std::all_of(function.use_begin(), function.use_end(), [](const llvm::Use& use) {
+            auto call = llvm::dyn_cast<llvm::CallInst>(use.getUser());
+            return call && call->isCallee(&use);
+        }))
+            fast.insert(&function);
+    }
+    // musttail needs the same convention on both sides
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& function : *m_module)
+            for (auto& inst : llvm::instructions(function)) {
+                auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                if (!call || !call->isMustTailCall() || !call->getCalledFunction())
+                    continue;
+                auto callee = call->getCalledFunction();
+                if (fast.count(&function) != fast.count(callee)) {
+                    fast.erase(&function);
+                    fast.erase(callee);
+                    changed = true;
+                }
+            }
+    }
+    for (auto function : fast) {
+        function->setCallingConv(llvm::CallingConv::Fast);
+        for (auto user : function->users())
+            llvm::cast<llvm::CallInst>(user)->setCallingConv(llvm::CallingConv::Fast);
     }
 
-    // scanf
-    auto scanfType = llvm::FunctionType::get(llvm::Type::getInt32Ty(m_context),
-            {llvm::Type::getInt8PtrTy(m_context)}, true);
-    auto scanfFun = llvm::Function::Create(scanfType, llvm::Function::ExternalLinkage,
-            "scanf", m_module.get());
+    // Variables used by main only become its locals
+    if (!main)
+        return;
+    llvm::IRBuilder<> builder(&main->getEntryBlock(), main->getEntryBlock().begin());
+    for (auto it = m_module->global_begin(); it != m_module->global_end();) {
+        auto& global = *it++;
+        if (global.isConstant() || global.isDeclaration() || global.use_empty())
+            continue;
+        if (!std::all_of(global.user_begin(), global.user_end(), [main](const llvm::User* user) {
+            auto inst = llvm::dyn_cast<llvm::Instruction>(user);
+            return inst && inst->getFunction() == main;
+        }))
+            continue;
+        auto name = global.getName().str();
+        auto local = builder.CreateAlloca(global.getValueType());
+        builder.CreateStore(global.getInitializer(), local);
+        global.replaceAllUsesWith(local);
+        m_globals.erase(name);
+        global.eraseFromParent();
+        local->setName(name);
+    }
+}
 
-    // readln(int)
-    {
-        auto readIntType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_context),
-                                                   {llvm::Type::getInt32PtrTy(m_context)}, false);
-        auto readIntFun = llvm::Function::Create(readIntType, llvm::Function::ExternalLinkage,
-                                                 "readInt", m_module.get());
-        auto readIntBlk = llvm::BasicBlock::Create(m_context, "start", readIntFun);
-        m_builder->SetInsertPoint(readIntBlk);
-        llvm::Value *readIntStr = m_builder->CreateGlobalStringPtr("%d[^\n]");
-        m_builder->CreateCall(scanfType, scanfFun, {readIntStr, readIntFun->getArg(0)});
-        m_builder->CreateRet(nullptr);
+void CodeGenerator::write_output(const char *fileName, const std::vector<std::string>& units) {
+    auto targetMachine = target_machine();
+
+    // Object code goes to memory first, the files are only the linker's input
+    std::vector<llvm::SmallVector<char, 0>> objects(partitions());
+    if (objects.size() == 1)
+        emit_object(objects[0]);
+    else {
+        // Each partition is compiled in its own context on its own thread. The split only
+        // depends on the module, so the objects are the same however the threads run.
+        std::vector<std::unique_ptr<llvm::raw_svector_ostream>> streams;
+        std::vector<llvm::raw_pwrite_stream*> outputs;
+        for (auto& object : objects) {
+            streams.push_back(std::make_unique<llvm::raw_svector_ostream>(object));
+            outputs.push_back(streams.back().get());
+        }
+        llvm::splitCodeGen(*m_module, outputs, {}, [this]() { return create_target_machine(); },
+                           llvm::CGFT_ObjectFile);
     }
 
-    // readln(double)
-    {
-        auto readDoubleType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_context),
-                                                      {llvm::Type::getDoublePtrTy(m_context)}, false);
-        auto readDoubleFun = llvm::Function::Create(readDoubleType, llvm::Function::ExternalLinkage,
-                                                    "readDouble", m_module.get());
-        auto readDoubleBlk = llvm::BasicBlock::Create(m_context, "start", readDoubleFun);
-        m_builder->SetInsertPoint(readDoubleBlk);
-        llvm::Value *readDoubleStr = m_builder->CreateGlobalStringPtr("%lf[^\n]");
-        m_builder->CreateCall(scanfType, scanfFun, {readDoubleStr, readDoubleFun->getArg(0)});
-        m_builder->CreateRet(nullptr);
+    // The first partition keeps the old name, the others get a numeric suffix and are gone after linking
+    std::vector<std::string> files;
+    std::vector<std::unique_ptr<llvm::FileRemover>> removers;
+    for (size_t i = 0; i < objects.size(); i++) {
+        files.push_back(i == 0 ? std::string(fileName) : std::string(fileName) + "." + std::to_string(i));
+        if (i > 0)
+            removers.push_back(std::make_unique<llvm::FileRemover>(files.back()));
+        write_file(files.back(), objects[i]);
     }
+    files.insert(files.end(), units.begin(), units.end());
+
+    Linker(targetMachine->getTargetTriple()).link(files, std::string(fileName) + ".bin");
+}
+
+void CodeGenerator::write_object(const std::string& fileName) {
+    llvm::SmallVector<char, 0> object;
+    emit_object(object);
+    write_file(fileName, object);
+}
+
+void CodeGenerator::emit_object(llvm::SmallVectorImpl<char>& object) {
+    llvm::raw_svector_ostream objectStream(object);
+
+    llvm::legacy::PassManager pass;
+
+    auto fileType = llvm::CGFT_ObjectFile;
+
+    if (target_machine()->addPassesToEmitFile(pass, objectStream, nullptr, fileType))
+        throw Exception("I don't want to do that");
+
+    pass.run(*m_module);
+}
+
+void CodeGenerator::write_file(const std::string& fileName, llvm::ArrayRef<char> contents) {
+    std::error_code errorCode;
+    llvm::raw_fd_ostream dest(fileName, errorCode, llvm::sys::fs::OF_None);
+
+    if (errorCode)
+        throw Exception(errorCode.message());
+
+    dest.write(contents.data(), contents.size());
+    dest.close();
+}
+
+// One per job, but no more than there are functions to compile
+size_t CodeGenerator::partitions() const {
+    // SplitModule cannot split a module with the multiversion dispatch ifuncs in it
+    if (!m_module->ifunc_empty())
+        return 1;
+    size_t functions = 0;
+    for (const auto& function : *m_module)
+        if (!function.isDeclaration())
+            functions++;
+    return std::max<size_t>(1, std::min<size_t>(m_options.jobs, functions));
+}
+
+// Only declared, link_runtime() brings in the ones the module calls
+void CodeGenerator::add_standard_functions() {
+    auto voidType = llvm::Type::getVoidTy(m_context);
+    // The strings write and writeln print
+    llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getInt32Ty(m_context),
+                                                   {llvm::Type::getInt8PtrTy(m_context)}, true),
+                           llvm::Function::ExternalLinkage, "printf", m_module.get());
+
+    auto declare = [this, voidType](const char* name, llvm::Type* arg) {
+        llvm::Function::Create(llvm::FunctionType::get(voidType, {arg}, false),
+                               llvm::Function::ExternalLinkage, name, m_module.get());
+    };
+    declare("writeInt", llvm::Type::getInt32Ty(m_context));
+    declare("writeLnInt", llvm::Type::getInt32Ty(m_context));
+    declare("writeDouble", llvm::Type::getDoubleTy(m_context));
+    declare("writeLnDouble", llvm::Type::getDoubleTy(m_context));
+    declare("readInt", llvm::Type::getInt32PtrTy(m_context));
+    declare("readDouble", llvm::Type::getDoublePtrTy(m_context));
+}
+
+// Every module gets private copies of just the runtime functions it calls,
+// so they inline and no two objects of a program define the same symbol
+void CodeGenerator::link_runtime() {
+    auto runtime = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(llvm::StringRef(reinterpret_cast<const char*>(g_runtimeBitcode),
+                                                  g_runtimeBitcodeSize), "runtime"), m_context);
+    if (!runtime)
+        throw Exception("Cannot load the runtime: " + llvm::toString(runtime.takeError()));
+    target_machine();
+    (*runtime)->setTargetTriple(m_module->getTargetTriple());
+    (*runtime)->setDataLayout(m_module->getDataLayout());
+    // Even an unused declaration would pull the definition in
+    for (const auto& function : **runtime)
+        if (auto declaration = m_module->getFunction(function.getName()))
+            if (declaration->isDeclaration() && declaration->use_empty())
+                declaration->eraseFromParent();
+
+    auto internalize = [](llvm::Module& module, const llvm::StringSet<>& linked) {
+        llvm::internalizeModule(module, [&linked](const llvm::GlobalValue& global) {
+            return !linked.count(global.getName());
+        });
+    };
+    if (llvm::Linker::linkModules(*m_module, std::move(*runtime), llvm::Linker::LinkOnlyNeeded, internalize))
+        throw Exception("Cannot link the runtime");
 }
 
 llvm::Value *CodeGenerator::gen_break(llvm::BasicBlock *breakTo, TextPosition position) {
-    if (breakTo)
-        return m_builder->CreateBr(breakTo);
-    throw Exception(position, "Break statement outside of loop");
+    if (!breakTo)
+        throw Exception(position, "Break statement outside of loop");
+    auto branch = m_builder->CreateBr(breakTo);
+    continue_unreachable();
+    return branch;
 }
 
 llvm::Value *CodeGenerator::gen_for(const std::shared_ptr<ForLoopExpression> expr, llvm::BasicBlock *exitTo) {
     auto function = m_builder->GetInsertBlock()->getParent();
-    auto controlBlock = llvm::BasicBlock::Create(m_context, "control", function);
     auto bodyBlock = llvm::BasicBlock::Create(m_context, "for_body", function);
-    auto afterBlock = llvm::BasicBlock::Create(m_context, "after", function);
+    auto afterBlock = llvm::BasicBlock::Create(m_context, "after");
+
+    llvm::Type* counterType = nullptr;
+    if (m_ssaVariables.count(expr->counter()))
+        counterType = m_ssaVariables[expr->counter()];
+    else if (auto alloca = m_variables[expr->counter()])
+        counterType = alloca->getAllocatedType();
+    else if (auto global = m_globals[expr->counter()])
+        counterType = global->getValueType();
+    if (counterType && counterType != m_builder->getInt32Ty())
+        throw Exception(expr->position(), "For-loop counter must be an integer");
 
     auto start = generate(expr->start(), nullptr, nullptr);
     auto finish = generate(expr->finish(), nullptr, nullptr);
+    if (start->getType() != m_builder->getInt32Ty() || finish->getType() != m_builder->getInt32Ty())
+        throw Exception(expr->position(), "For-loop bounds must be integers");
 
+    // Preheader: the loop runs |finish - start| times, skip it entirely if that is not positive
     assign(expr->counter(), start, expr->position());
-    m_builder->CreateBr(controlBlock);
-
-    m_builder->SetInsertPoint(controlBlock);
-    auto countValue = load(expr->counter(), expr->position());
-    if (countValue->getType() != llvm::Type::getInt32Ty(m_context))
-        throw Exception(expr->position(), "For-loop counter must be an integer");
-    auto stop = m_builder->CreateICmpEQ(countValue, finish, "stop");
-    m_builder->CreateCondBr(stop, afterBlock, bodyBlock);
+    auto enter = expr->down() ? m_builder->CreateICmpSGT(start, finish, "enter")
+                              : m_builder->CreateICmpSLT(start, finish, "enter");
+    auto preheader = m_builder->GetInsertBlock();
+    m_builder->CreateCondBr(enter, bodyBlock, afterBlock);
 
+    // Body with the induction variable kept in SSA form
     m_builder->SetInsertPoint(bodyBlock);
+    auto inductionVar = m_builder->CreatePHI(m_builder->getInt32Ty(), 2, expr->counter());
+    inductionVar->addIncoming(start, preheader);
+    if (m_ssaVariables.count(expr->counter()))
+        write_variable(expr->counter(), bodyBlock, inductionVar);
+    m_loopCounters.insert(expr->counter());
     generate(expr->body(), afterBlock, exitTo);
-    static auto one = llvm::ConstantInt::get(llvm::Type::getInt32Ty(m_context), 1);
+    m_loopCounters.erase(expr->counter());
+
+    // Latch: step and test at the bottom
+    auto latch = m_builder->GetInsertBlock();
+    auto one = m_builder->getInt32(1);
     llvm::Value* newCount;
     if (expr->down())
-        newCount = m_builder->CreateSub(countValue, one, "newcount");
+        newCount = m_builder->CreateNSWSub(inductionVar, one, "newcount");
     else
-        newCount = m_builder->CreateAdd(countValue, one, "newcount");
-    assign(std::move(expr->counter()), newCount, expr->position());
-    m_builder->CreateBr(controlBlock);
+        newCount = m_builder->CreateNSWAdd(inductionVar, one, "newcount");
+    assign(expr->counter(), newCount, expr->position());
+    auto again = m_builder->CreateICmpNE(newCount, finish, "again");
+    auto backEdge = m_builder->CreateCondBr(again, bodyBlock, afterBlock);
+    backEdge->setMetadata(llvm::LLVMContext::MD_loop, create_loop_id());
+    inductionVar->addIncoming(newCount, latch);
+    seal_block(bodyBlock);
+    seal_block(afterBlock);
 
+    function->getBasicBlockList().push_back(afterBlock);
     m_builder->SetInsertPoint(afterBlock);
     return function;
 }
 
+llvm::MDNode *CodeGenerator::create_loop_id() {
+    // Self-referencing distinct node, as required for llvm.loop
+    llvm::Metadata* properties[] = {
+            nullptr,
+            llvm::MDNode::get(m_context, llvm::MDString::get(m_context, "llvm.loop.mustprogress"))
+    };
+    auto loopId = llvm::MDNode::getDistinct(m_context, properties);
+    loopId->replaceOperandWith(0, loopId);
+    return loopId;
+}
+
 llvm::Value *CodeGenerator::assign(std::string name, llvm::Value *value, TextPosition position) {
+    if (m_loopCounters.count(name))
+        throw Exception(std::move(position), "Cannot change for-loop counter: " + name);
+    auto ssaVariable = m_ssaVariables.find(name);
+    if (ssaVariable != m_ssaVariables.end()) {
+        if (value->getType() != ssaVariable->second)
+            throw Exception(std::move(position), "Type mismatch in assignment to " + name);
+        write_variable(name, m_builder->GetInsertBlock(), value);
+        return value;
+    }
     llvm::Value* var;
     if ((var = m_variables[name]) || (var = m_globals[name]))
         return m_builder->CreateStore(value, var);
@@ -523,19 +1212,157 @@ llvm::Value *CodeGenerator::assign(std::string name, llvm::Value *value, TextPos
     throw Exception(std::move(position), "Unknown identifier: " + name);
 }
 
+// SSA construction after Braun et al., "Simple and Efficient Construction of Static Single Assignment Form"
+
+void CodeGenerator::write_variable(const std::string &name, llvm::BasicBlock *block, llvm::Value *value) {
+    m_currentDef[block][name] = value;
+}
+
+llvm::Value *CodeGenerator::read_variable(const std::string &name, llvm::BasicBlock *block) {
+    auto& defs = m_currentDef[block];
+    auto it = defs.find(name);
+    if (it != defs.end())
+        return it->second;
+    return read_variable_recursive(name, block);
+}
+
+llvm::Value *CodeGenerator::read_variable_recursive(const std::string &name, llvm::BasicBlock *block) {
+    llvm::Value* value;
+    if (!m_sealedBlocks.count(block)) {
+        // Not all predecessors are known yet
+        auto phi = create_phi(name, block);
+        m_incompletePhis[block][name] = phi;
+        value = phi;
+    } else if (auto pred = block->getSinglePredecessor()) {
+        value = read_variable(name, pred);
+    } else if (llvm::pred_empty(block)) {
+        value = llvm::UndefValue::get(m_ssaVariables[name]);
+    } else {
+        // Break potential cycles with an operandless phi
+        auto phi = create_phi(name, block);
+        write_variable(name, block, phi);
+        value = add_phi_operands(name, phi);
+    }
+    write_variable(name, block, value);
+    return value;
+}
+
+llvm::PHINode *CodeGenerator::create_phi(const std::string &name, llvm::BasicBlock *block) {
+    if (block->empty())
+        return llvm::PHINode::Create(m_ssaVariables[name], 0, name, block);
+    return llvm::PHINode::Create(m_ssaVariables[name], 0, name, &block->front());
+}
+
+llvm::Value *CodeGenerator::add_phi_operands(const std::string &name, llvm::PHINode *phi) {
+    for (auto pred : llvm::predecessors(phi->getParent()))
+        phi->addIncoming(read_variable(name, pred), pred);
+    return try_remove_trivial_phi(phi);
+}
+
+llvm::Value *CodeGenerator::try_remove_trivial_phi(llvm::PHINode *phi) {
+    llvm::Value* same = nullptr;
+    for (auto& op : phi->incoming_values()) {
+        if (op == same || op == phi)
+            continue;
+        if (same)
+            return phi;     // merges at least two values
+        same = op;
+    }
+    if (!same)
+        same = llvm::UndefValue::get(phi->getType());
+
+    llvm::SmallVector<llvm::WeakVH, 8> users;
+    for (auto user : phi->users())
+        if (user != phi && llvm::isa<llvm::PHINode>(user))
+            users.emplace_back(user);
+    phi->replaceAllUsesWith(same);
+    for (auto& defs : m_currentDef)
+        for (auto& def : defs.second)
+            if (def.second == phi)
+                def.second = same;
+    phi->eraseFromParent();
+
+    // Phis using this one might have become trivial as well
+    for (auto& user : users)
+        if (auto userPhi = llvm::dyn_cast_or_null<llvm::PHINode>(user))
+            try_remove_trivial_phi(userPhi);
+    return same;
+}
+
+void CodeGenerator::seal_block(llvm::BasicBlock *block) {
+    for (auto& incomplete : m_incompletePhis[block])
+        add_phi_operands(incomplete.first, incomplete.second);
+    m_incompletePhis.erase(block);
+    m_sealedBlocks.insert(block);
+}
+
+void CodeGenerator::collect_read_targets(const ExpressionPointer expr, std::set<std::string> &names) {
+    if (!expr)
+        return;
+    switch (expr->type()) {
+        case EXPR_CALL: {
+            auto call = std::static_pointer_cast<CallExpression>(expr);
+            if (call->name() == "readln")
+                for (const auto& arg : call->args())
+                    if (arg->type() == EXPR_IDENTIFIER)
+                        names.insert(std::static_pointer_cast<IdentifierExpression>(arg)->value());
+            break;
+        }
+        case EXPR_BLOCK:
+            for (const auto& e : std::static_pointer_cast<BlockExpression>(expr)->body())
+                collect_read_targets(e, names);
+            break;
+        case EXPR_CONDITION: {
+            auto condition = std::static_pointer_cast<ConditionExpression>(expr);
+            collect_read_targets(condition->thenBody(), names);
+            collect_read_targets(condition->elseBody(), names);
+            break;
+        }
+        case EXPR_CASE: {
+            auto caseExpr = std::static_pointer_cast<CaseExpression>(expr);
+            for (const auto& branch : caseExpr->branches())
+                collect_read_targets(branch.body, names);
+            collect_read_targets(caseExpr->otherwise(), names);
+            break;
+        }
+        case EXPR_WHILE_LOOP:
+            collect_read_targets(std::static_pointer_cast<WhileLoopExpression>(expr)->body(), names);
+            break;
+        case EXPR_FOR_LOOP:
+            collect_read_targets(std::static_pointer_cast<ForLoopExpression>(expr)->body(), names);
+            break;
+        default:
+            break;
+    }
+}
+
 llvm::Value *CodeGenerator::load(const std::string &name, TextPosition position) {
     llvm::Value* value;
     if ((value = m_constants[name]))
         return value;
-    if ((value = m_variables[name]) || (value = m_globals[name]))
-        return m_builder->CreateLoad(value, name);
+    if (m_ssaVariables.count(name))
+        return read_variable(name, m_builder->GetInsertBlock());
+    if (auto variable = m_variables[name])
+        return m_builder->CreateLoad(variable->getAllocatedType(), variable, name);
+    if (auto global = m_globals[name])
+        return m_builder->CreateLoad(global->getValueType(), global, name);
     throw Exception(std::move(position), "Unknown identifier: " + name);
 }
 
 llvm::Value *CodeGenerator::gen_exit(llvm::BasicBlock *exitTo, TextPosition position) {
-    if (exitTo)
-        return m_builder->CreateBr(exitTo);
-    throw Exception("");
+    if (!exitTo)
+        throw Exception(position, "Exit statement outside of function or program");
+    auto branch = m_builder->CreateBr(exitTo);
+    continue_unreachable();
+    return branch;
+}
+
+void CodeGenerator::continue_unreachable() {
+    // Code following a jump still needs a block to go into
+    auto function = m_builder->GetInsertBlock()->getParent();
+    auto block = llvm::BasicBlock::Create(m_context, "unreachable", function);
+    seal_block(block);
+    m_builder->SetInsertPoint(block);
 }
 
 llvm::Value *CodeGenerator::gen_parentheses(std::shared_ptr<ParenthesesExpression> expr) {
@@ -0,0 +1,107 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/Compilation.h"
+#include "../include/CodeGenerator.h"
+#include "../include/Exception.h"
+#include "../include/Parser.h"
+#include "../include/UnitBuilder.h"
+
+#include <exception>
+#include <sstream>
+
+
+std::string Compilation::Diagnostic::to_string() const {
+    std::string text;
+    if (position.line)
+        text = std::to_string(position.line) + ':' + std::to_string(position.column) + ": ";
+    return text + (error ? "error: " : "warning: ") + message;
+}
+
+Compilation::Compilation(std::string source, Options options) :
+        m_source(std::move(source)),
+        m_options(std::move(options)) {}
+
+Compilation::~Compilation() = default;
+
+template<typename Step>
+bool Compilation::attempt(Step step) {
+    if (m_failed)
+        return false;
+    try {
+        step();
+    } catch (Exception& e) {
+        m_diagnostics.push_back({true, e.has_position() ? e.position() : TextPosition{0, 0}, e.message()});
+        m_failed = true;
+    } catch (std::exception& e) {
+        m_diagnostics.push_back({true, {0, 0}, e.what()});
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+void Compilation::warn(const std::list<std::pair<TextPosition, std::string>>& warnings) {
+    for (const auto& warning : warnings)
+        m_diagnostics.push_back({false, warning.first, warning.second});
+}
+
+bool Compilation::parse() {
+    if (m_tree)
+        return true;
+    return attempt([this]() {
+        std::istringstream stream(m_source);
+        Parser parser(stream);
+        parser.parse();
+        auto tree = parser.get_tree();
+        if (!tree->uses().empty()) {
+            UnitBuilder units(m_options, m_options.unitDirectories);
+            tree = units.import(tree);
+            m_unitObjects = units.objects();
+            for (const auto& warning : units.warnings())
+                m_diagnostics.push_back({false, {0, 0}, warning});
+        }
+        m_tree = tree;
+    });
+}
+
+bool Compilation::generate() {
+    if (!parse())
+        return false;
+    if (m_generator)
+        return true;
+    return attempt([this]() {
+        auto generator = std::make_unique<CodeGenerator>(m_tree, m_options);
+        if (std::dynamic_pointer_cast<UnitExpression>(m_tree))
+            generator->generate_unit();
+        else
+            generator->generate_code();
+        generator->optimize();
+        warn(generator->warnings());
+        m_generator = std::move(generator);
+    });
+}
+
+bool Compilation::emit() {
+    if (!generate())
+        return false;
+    if (m_emitted)
+        return true;
+    return attempt([this]() {
+        if (m_moduleTaken)
+            throw Exception("The module has been taken, there is nothing left to emit");
+        m_generator->emit_object(m_object);
+        m_emitted = true;
+    });
+}
+
+llvm::Module* Compilation::module() const {
+    return m_generator && !m_moduleTaken ? m_generator->module() : nullptr;
+}
+
+llvm::orc::ThreadSafeModule Compilation::take_module() {
+    if (!generate() || m_moduleTaken)
+        return llvm::orc::ThreadSafeModule();
+    m_moduleTaken = true;
+    return m_generator->take_module();
+}
@@ -0,0 +1,252 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/Driver.h"
+#include "../include/BytecodeCompiler.h"
+#include "../include/CodeGenerator.h"
+#include "../include/Exception.h"
+#include "../include/IncrementalBuild.h"
+#include "../include/JIT.h"
+#include "../include/ObjectCache.h"
+#include "../include/Parser.h"
+#include "../include/UnitBuilder.h"
+#include "../include/VM.h"
+
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_os_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+
+Driver::Driver(std::string program, std::ostream& out, std::ostream& err) :
+        m_program(std::move(program)),
+        m_out(out),
+        m_err(err) {}
+
+int Driver::run(const std::vector<std::string>& args) {
+    return compile(args, nullptr);
+}
+
+int Driver::run(const std::vector<std::string>& args, const std::string& source) {
+    return compile(args, &source);
+}
+
+void Driver::usage() {
+    m_err << "Usage: " << m_program
+          << " [-O0|-O1|-O2|-O3|-Os|-Oz] [-mcpu=<cpu>|-march=native] [-mattr=<features>]\n"
+          << "\t[-fmultiversion=auto|<function>,...] [-fwhole-program] [-fssa] [-j[<jobs>]] [-I<dir>]\n"
+          << "\t[--cache] [--cache-dir=<dir>] [--cache-size=<MiB>] [--incremental]\n"
+          << "\t[--run] [--tiered] [--tier-threshold=<calls>] [--lazy] [--vm] <source> [output]" << std::endl;
+}
+
+void Driver::print_position(std::istream& file, TextPosition pos) {
+    m_err << "LINE " << pos.line << "; COLUMN " << pos.column << ':' << std::endl;
+    file.clear();
+    file.seekg(0, std::ios::beg);
+    std::string line;
+    for (int i = 0; i < pos.line; i++)
+        std::getline(file, line);
+    m_err << line << std::endl;
+
+    for (int i = 0; i < pos.column - 1; i++)
+        m_err << '~';
+    m_err << '^';
+    for (int i = pos.column; i < line.length(); i++)
+        m_err << '~';
+    m_err << std::endl;
+}
+
+void Driver::print_warnings(std::istream& file, const std::list<std::pair<TextPosition, std::string>>& warnings) {
+    for (const auto& warning : warnings) {
+        if (warning.first.line)
+            print_position(file, warning.first);
+        m_err << "WARNING:\t" << warning.second << std::endl;
+    }
+}
+
+int Driver::compile(const std::vector<std::string>& args, const std::string* text) {
+    Options options;
+    std::vector<std::string> positional;
+    for (const auto& arg : args) {
+        if (arg.size() > 1 && arg[0] == '-') {
+            if (!options.parse(arg)) {
+                m_err << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        } else
+            positional.push_back(arg);
+    }
+    if (positional.empty()) {
+        usage();
+        return 1;
+    }
+
+    const char* fileName = positional[0].c_str();
+    std::string source;
+    if (text)
+        source = *text;
+    else {
+        std::ifstream stream(fileName);
+        if (stream.fail()) {
+            m_out << "File not open" << std::endl;
+            return 1;
+        }
+        std::ostringstream reading;
+        reading << stream.rdbuf();
+        source = reading.str();
+    }
+    std::istringstream file(source);
+    Parser parser(file);
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        const char* outFile = positional.size() >= 2 ? positional[1].c_str() : "output";
+
+        std::unique_ptr<ObjectCache> cache;
+        std::string cacheKey;
+        auto printCache = [this, &cache](bool hit) {
+            auto statistics = cache->statistics();
+            m_err << "Cache:\t" << (hit ? "hit" : "miss") << " (" << statistics.hits << " hits, "
+                  << statistics.misses << " misses, " << statistics.entries << " entries, "
+                  << (statistics.size >> 10) << " KiB)" << std::endl;
+        };
+        parser.parse();
+        auto tree = parser.get_tree();
+        // The key covers only the program's own source, not the units it uses
+        if (options.cache && !options.run && !options.vm && tree->uses().empty()
+                && !std::dynamic_pointer_cast<UnitExpression>(tree)) {
+            cache = std::make_unique<ObjectCache>(
+                    options.cacheDir.empty() ? ObjectCache::default_directory() : options.cacheDir,
+                    uint64_t(options.cacheSize) << 20);
+            cacheKey = cache->key(source, options);
+            if (cache->fetch(cacheKey, std::string(outFile) + ".bin")) {
+                printCache(true);
+                // The echo a miss prints, stdout must not depend on the cache
+                m_out << parser.get_source() << std::endl;
+                return 0;
+            }
+        }
+        // Units are looked up next to the program first
+        std::vector<std::string> unitDirectories = {std::string(llvm::sys::path::parent_path(fileName))};
+        if (unitDirectories.front().empty())
+            unitDirectories.front() = ".";
+        unitDirectories.insert(unitDirectories.end(), options.unitDirectories.begin(),
+                               options.unitDirectories.end());
+        UnitBuilder units(options, unitDirectories);
+        if (auto unit = std::dynamic_pointer_cast<UnitExpression>(tree)) {
+            if (options.run || options.vm)
+                throw Exception("A unit cannot be run, only a program using it");
+            units.build(unit->name());
+            for (const auto& warning : units.warnings())
+                m_err << "WARNING:\t" << warning << std::endl;
+            m_err << "Compiled:\t" << units.compiled() << " units" << std::endl;
+            return 0;
+        }
+        if (!tree->uses().empty()) {
+            if (options.vm)
+                throw Exception("--vm does not support units");
+            tree = units.import(tree);
+            for (const auto& warning : units.warnings())
+                m_err << "WARNING:\t" << warning << std::endl;
+        }
+        if (options.vm) {
+            auto program = BytecodeCompiler(tree).compile();
+            auto compiled = std::chrono::steady_clock::now();
+            int status = VM(program).run();
+            auto finished = std::chrono::steady_clock::now();
+            m_err << "Compile time:\t" << std::chrono::duration<double, std::milli>(compiled - start).count()
+                  << " ms" << std::endl
+                  << "Execution time:\t" << std::chrono::duration<double, std::milli>(finished - compiled).count()
+                  << " ms" << std::endl;
+            return status;
+        }
+        if (options.lazy) {
+            if (options.tiered || options.wholeProgram)
+                m_err << "WARNING:\t--tiered and -fwhole-program are ignored with --lazy" << std::endl;
+            options.tiered = options.wholeProgram = false;
+            CodeGenerator generator(tree, options);
+            generator.generate_main();
+            generator.optimize();
+            print_warnings(file, generator.warnings());
+
+            std::vector<std::string> functions;
+            for (const auto& function : tree->functions())
+                if (function->body() && std::find(functions.begin(), functions.end(), function->name()) == functions.end())
+                    functions.push_back(function->name());
+            // Runs on whichever thread first calls the function
+            std::mutex printing;
+            auto factory = [&](const std::string& name) {
+                CodeGenerator unit(tree, options);
+                unit.generate_function(name);
+                unit.optimize();
+                std::lock_guard<std::mutex> lock(printing);
+                print_warnings(file, unit.warnings());
+                return unit.take_module();
+            };
+            double frontendTime = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+            JIT jit(options);
+            jit.add_objects(units.objects());
+            int status = jit.run_lazy(generator.take_module(), functions, factory);
+            m_err << "Compile time:\t" << frontendTime + jit.compile_time() << " ms" << std::endl
+                  << "Execution time:\t" << jit.execution_time() << " ms" << std::endl
+                  << "Compiled lazily:\t" << jit.lazily_compiled() << " of " << functions.size()
+                  << " functions" << std::endl;
+            return status;
+        }
+        if (options.incremental) {
+            if (options.wholeProgram)
+                m_err << "WARNING:\t-fwhole-program is ignored with --incremental" << std::endl;
+            options.wholeProgram = false;
+            IncrementalBuild build(tree, options, std::string(outFile) + ".functions");
+            build.build(std::string(outFile) + ".bin", units.objects());
+            print_warnings(file, build.warnings());
+            m_err << "Compiled:\t" << build.compiled() << " of " << build.total() << " objects" << std::endl;
+            if (cache) {
+                cache->store(cacheKey, std::string(outFile) + ".bin");
+                printCache(false);
+            }
+            m_out << parser.get_source() << std::endl;
+            return 0;
+        }
+        CodeGenerator generator(tree, options);
+        generator.generate_code();
+        generator.optimize();
+        print_warnings(file, generator.warnings());
+        if (options.run) {
+            double frontendTime = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+            JIT jit(options);
+            jit.add_objects(units.objects());
+            int status = jit.run(generator.take_module());
+            for (const auto& warning : jit.warnings())
+                m_err << "WARNING:\t" << warning << std::endl;
+            m_err << "Compile time:\t" << frontendTime + jit.compile_time() << " ms" << std::endl
+                  << "Execution time:\t" << jit.execution_time() << " ms" << std::endl;
+            if (options.tiered)
+                m_err << "Recompiled:\t" << jit.recompiled() << " functions" << std::endl;
+            return status;
+        }
+        if (m_printIR) {
+            llvm::raw_os_ostream ir(m_err);
+            generator.print(ir);
+        }
+        generator.write_output(outFile, units.objects());
+        if (cache) {
+            cache->store(cacheKey, std::string(outFile) + ".bin");
+            printCache(false);
+        }
+    } catch (Exception& e) {
+        if (e.has_position())
+            print_position(file, e.position());
+        m_err << "ERROR:\t" << e.message() << std::endl;
+        return 2;
+    }
+    m_out << parser.get_source() << std::endl;
+    return 0;
+}
@@ -4,6 +4,16 @@
 
 #include "../include/Expression.h"
 
+#include <iomanip>
+#include <limits>
+#include <map>
+
+
+static std::string type_name(TokenType type) {
+    static const std::map<TokenType, std::string> dataTypeMap = {{TOK_INTEGER, "integer"}, {TOK_DOUBLE, "double"}};
+    auto it = dataTypeMap.find(type);
+    return it != dataTypeMap.end() ? it->second : std::to_string(type);
+}
 
 std::string IntegerExpression::to_string() const {
     return std::to_string(m_value);
@@ -43,6 +53,10 @@ std::string BinaryOperationExpression::to_string() const {
     return '(' + m_left->to_string() + ')' + m_operator->to_string() + '(' + m_right->to_string() + ')';
 }
 
+std::string UnaryOperationExpression::to_string() const {
+    return (m_operator == TOK_NOT ? "not(" : "-(") + m_operand->to_string() + ')';
+}
+
 std::string ConstExpression::to_string() const {
     std::ostringstream oss;
     for (const auto& c : m_consts)
@@ -53,12 +67,12 @@ std::string ConstExpression::to_string() const {
 std::string VarExpression::to_string() const {
     std::ostringstream oss;
     for (const auto& v : m_vars)
-        oss << "var " << v.first << " : " << "integer" << ';' << std::endl;
+        oss << "var " << v.first << " : " << type_name(v.second) << ';' << std::endl;
     return oss.str();
 }
 
 std::string FunctionExpression::to_string() const {
-    std::ostringstream oss("function ", std::ios::ate);
+    std::ostringstream oss(m_type == TOK_VOID ? "procedure " : "function ", std::ios::ate);
     oss << m_name << '(';
     bool first = true;
     for (const Variable& arg : m_arguments) {
@@ -66,13 +80,12 @@ std::string FunctionExpression::to_string() const {
             first = false;
         else
             oss << "; ";
-        oss << arg.first << ": " << arg.second;
+        oss << arg.first << ": " << type_name(arg.second);
     }
-    static const std::map<TokenType, std::string> dataTypeMap = {{TOK_INTEGER, "integer"}};
     if (m_type == TOK_VOID)
         oss << ");" << std::endl;
     else
-        oss << "): " << dataTypeMap.at(m_type) << ';' << std::endl;
+        oss << "): " << type_name(m_type) << ';' << std::endl;
     if (m_consts)
         oss << m_consts->to_string();
     if (m_vars)
@@ -82,8 +95,16 @@ std::string FunctionExpression::to_string() const {
     return oss.str();
 }
 
+static std::string uses_to_string(const std::list<std::string>& uses) {
+    std::string result;
+    for (const auto& unit : uses)
+        result += (result.empty() ? "uses " : ", ") + unit;
+    return result.empty() ? result : result + ";\n";
+}
+
 std::string TopLevelExpression::to_string() const {
     std::ostringstream oss;
+    oss << uses_to_string(m_uses);
     if (m_consts)
         oss << m_consts->to_string();
     if (m_vars)
@@ -94,6 +115,55 @@ std::string TopLevelExpression::to_string() const {
     return oss.str();
 }
 
+std::string UnitExpression::to_string() const {
+    std::ostringstream oss;
+    oss << "unit " << m_name << ';' << std::endl << "interface" << std::endl << uses_to_string(uses());
+    for (const auto& c : consts())
+        if (m_exports.count(c.first))
+            oss << "const " << c.first << '=' << c.second->to_string() << ';' << std::endl;
+    for (const auto& v : vars())
+        if (m_exports.count(v.first))
+            oss << "var " << v.first << " : " << type_name(v.second) << ';' << std::endl;
+    oss << "implementation" << std::endl;
+    for (const auto& c : consts())
+        if (!m_exports.count(c.first))
+            oss << "const " << c.first << '=' << c.second->to_string() << ';' << std::endl;
+    for (const auto& v : vars())
+        if (!m_exports.count(v.first))
+            oss << "var " << v.first << " : " << type_name(v.second) << ';' << std::endl;
+    for (const auto& fun : functions())
+        oss << fun->to_string();
+    oss << "end.";
+    return oss.str();
+}
+
+std::string UnitExpression::summary() const {
+    std::ostringstream oss;
+    oss << "unit " << m_name << ';' << std::endl << "interface" << std::endl << uses_to_string(uses());
+    for (const auto& c : consts())
+        if (m_exports.count(c.first))
+            oss << "const " << c.first << " = " << c.second->to_string() << ';' << std::endl;
+    for (const auto& v : vars())
+        if (m_exports.count(v.first))
+            oss << "var " << v.first << " : " << type_name(v.second) << ';' << std::endl;
+    // Headers only, the interface of a unit never has bodies
+    std::set<std::string> written;
+    for (const auto& fun : functions())
+        if (m_exports.count(fun->name()) && written.insert(fun->name()).second) {
+            oss << (fun->return_type() == TOK_VOID ? "procedure " : "function ") << fun->name() << '(';
+            auto names = fun->arg_names();
+            auto types = fun->arg_types();
+            for (size_t i = 0; i < names.size(); i++)
+                oss << (i ? "; " : "") << names[i] << " : " << type_name(types[i]);
+            oss << ')';
+            if (fun->return_type() != TOK_VOID)
+                oss << " : " << type_name(fun->return_type());
+            oss << ';' << std::endl;
+        }
+    oss << "implementation" << std::endl << "end." << std::endl;
+    return oss.str();
+}
+
 std::string ConditionExpression::to_string() const {
     std::ostringstream oss;
     oss << "if " << m_condition->to_string() << " then" << std::endl;
@@ -103,6 +173,27 @@ std::string ConditionExpression::to_string() const {
     return oss.str();
 }
 
+std::string CaseExpression::to_string() const {
+    std::ostringstream oss;
+    oss << "case " << m_selector->to_string() << " of" << std::endl;
+    for (const auto& branch : m_branches) {
+        bool first = true;
+        for (const auto& label : branch.labels) {
+            if (!first)
+                oss << ", ";
+            oss << label.first->to_string();
+            if (label.second)
+                oss << ".." << label.second->to_string();
+            first = false;
+        }
+        oss << ": " << (branch.body ? branch.body->to_string() : "") << ';' << std::endl;
+    }
+    if (m_otherwise)
+        oss << "else " << m_otherwise->to_string() << std::endl;
+    oss << "end";
+    return oss.str();
+}
+
 std::string WhileLoopExpression::to_string() const {
     std::stringstream oss;
     oss << "while " << m_condition->to_string() << " do" << std::endl;
@@ -120,8 +211,11 @@ std::string ForLoopExpression::to_string() const {
     return oss.str();
 }
 
+// Round-trips, so different literals never print the same
 std::string DoubleExpression::to_string() const {
-    return std::to_string(m_value);
+    std::ostringstream oss;
+    oss << std::setprecision(std::numeric_limits<double>::max_digits10) << m_value;
+    return oss.str();
 }
 
 std::string AssignExpression::to_string() const {
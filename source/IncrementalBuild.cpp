@@ -0,0 +1,204 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/IncrementalBuild.h"
+#include "../include/CodeGenerator.h"
+#include "../include/Exception.h"
+#include "../include/Linker.h"
+#include "../include/ObjectCache.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+
+
+static const char* const objectSuffix = ".o";
+
+IncrementalBuild::IncrementalBuild(std::shared_ptr<TopLevelExpression> tree, Options options, std::string directory) :
+        m_tree(std::move(tree)),
+        m_options(std::move(options)),
+        m_directory(std::move(directory)) {
+    if (auto errorCode = llvm::sys::fs::create_directories(m_directory))
+        throw Exception("Cannot create " + m_directory + ": " + errorCode.message());
+
+    for (const auto& c : m_tree->consts())
+        m_declarations[c.first] = "const " + c.first + '=' + c.second->to_string();
+    for (const auto& var : m_tree->vars())
+        m_declarations[var.first] = "var " + var.first + ':' + std::to_string(var.second);
+    for (const auto& var : m_tree->externals())
+        m_declarations[var.first] = "extern var " + var.first + ':' + std::to_string(var.second);
+    for (const auto& function : m_tree->functions()) {
+        std::string signature = "function " + function->name() + '(';
+        for (auto type : function->arg_types())
+            signature += std::to_string(type) + ';';
+        m_declarations[function->name()] = signature + "):" + std::to_string(function->return_type());
+    }
+}
+
+void IncrementalBuild::collect_names(const ExpressionPointer& expr, std::set<std::string>& names) {
+    if (!expr)
+        return;
+    switch (expr->type()) {
+        case EXPR_IDENTIFIER:
+            names.insert(std::static_pointer_cast<IdentifierExpression>(expr)->value());
+            break;
+        case EXPR_CALL: {
+            auto call = std::static_pointer_cast<CallExpression>(expr);
+            names.insert(call->name());
+            for (const auto& arg : call->args())
+                collect_names(arg, names);
+            break;
+        }
+        case EXPR_ASSIGN: {
+            auto assign = std::static_pointer_cast<AssignExpression>(expr);
+            names.insert(assign->name());
+            collect_names(assign->value(), names);
+            break;
+        }
+        case EXPR_BLOCK:
+            for (const auto& e : std::static_pointer_cast<BlockExpression>(expr)->body())
+                collect_names(e, names);
+            break;
+        case EXPR_PARENTHESES:
+            collect_names(std::static_pointer_cast<ParenthesesExpression>(expr)->expression(), names);
+            break;
+        case EXPR_BINARY_OPERATION: {
+            auto operation = std::static_pointer_cast<BinaryOperationExpression>(expr);
+            collect_names(operation->left(), names);
+            collect_names(operation->right(), names);
+            break;
+        }
+        case EXPR_UNARY_OPERATION:
+            collect_names(std::static_pointer_cast<UnaryOperationExpression>(expr)->operand(), names);
+            break;
+        case EXPR_CONDITION: {
+            auto condition = std::static_pointer_cast<ConditionExpression>(expr);
+            collect_names(condition->condition(), names);
+            collect_names(condition->thenBody(), names);
+            collect_names(condition->elseBody(), names);
+            break;
+        }
+        case EXPR_CASE: {
+            auto caseExpr = std::static_pointer_cast<CaseExpression>(expr);
+            collect_names(caseExpr->selector(), names);
+            for (const auto& branch : caseExpr->branches()) {
+                for (const auto& label : branch.labels) {
+                    collect_names(label.first, names);
+                    collect_names(label.second, names);
+                }
+                collect_names(branch.body, names);
+            }
+            collect_names(caseExpr->otherwise(), names);
+            break;
+        }
+        case EXPR_WHILE_LOOP: {
+            auto loop = std::static_pointer_cast<WhileLoopExpression>(expr);
+            collect_names(loop->condition(), names);
+            collect_names(loop->body(), names);
+            break;
+        }
+        case EXPR_FOR_LOOP: {
+            auto loop = std::static_pointer_cast<ForLoopExpression>(expr);
+            names.insert(loop->counter());
+            collect_names(loop->start(), names);
+            collect_names(loop->finish(), names);
+            collect_names(loop->body(), names);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+std::string IncrementalBuild::function_hash(const std::shared_ptr<FunctionExpression>& function) {
+    std::set<std::string> names;
+    collect_names(function->body(), names);
+    for (const auto& c : function->consts())
+        collect_names(c.second, names);
+
+    // Locals shadow globals, the function's own name is its result
+    std::set<std::string> locals = {function->name()};
+    for (const auto& arg : function->arg_names())
+        locals.insert(arg);
+    for (const auto& var : function->vars())
+        locals.insert(var.first);
+    for (const auto& c : function->consts())
+        locals.insert(c.first);
+
+    // The set keeps them sorted, so the hash does not depend on the order of use
+    std::string content = function->to_string();
+    for (const auto& name : names) {
+        auto declaration = m_declarations.find(name);
+        if (!locals.count(name) && declaration != m_declarations.end())
+            content += '\0' + declaration->second;
+    }
+    return ObjectCache::key(content, m_options);
+}
+
+// Main defines the globals and declares every function
+std::string IncrementalBuild::main_hash() {
+    std::string content = "main";
+    for (const auto& declaration : m_declarations)
+        content += '\0' + declaration.second;
+    content += '\0' + m_tree->body()->to_string();
+    return ObjectCache::key(content, m_options);
+}
+
+std::string IncrementalBuild::object(const std::string& hash) const {
+    llvm::SmallString<128> path(m_directory);
+    llvm::sys::path::append(path, hash + objectSuffix);
+    return std::string(path.str());
+}
+
+template<typename Generate>
+void IncrementalBuild::compile(const std::string& hash, Generate generate) {
+    m_total++;
+    if (llvm::sys::fs::exists(object(hash)))
+        return;
+
+    CodeGenerator generator(m_tree, m_options);
+    generate(generator);
+    generator.optimize();
+    m_warnings.insert(m_warnings.end(), generator.warnings().begin(), generator.warnings().end());
+
+    llvm::SmallString<128> temporary;
+    llvm::sys::fs::createUniquePath(m_directory + "/tmp-%%%%%%%%", temporary, false);
+    generator.write_object(std::string(temporary.str()));
+    if (auto errorCode = llvm::sys::fs::rename(temporary, object(hash))) {
+        llvm::sys::fs::remove(temporary);
+        throw Exception("Cannot write " + object(hash) + ": " + errorCode.message());
+    }
+    m_compiled++;
+}
+
+void IncrementalBuild::build(const std::string& output, const std::vector<std::string>& units) {
+    m_compiled = m_total = 0;
+    m_warnings.clear();
+
+    std::set<std::string> objects;
+    auto hash = main_hash();
+    compile(hash, [](CodeGenerator& generator) { generator.generate_main(); });
+    objects.insert(object(hash));
+
+    std::set<std::string> defined;
+    for (const auto& function : m_tree->functions()) {
+        if (!function->body() || !defined.insert(function->name()).second)
+            continue;
+        hash = function_hash(function);
+        auto name = function->name();
+        compile(hash, [&name](CodeGenerator& generator) { generator.generate_function(name); });
+        objects.insert(object(hash));
+    }
+
+    std::vector<std::string> files(objects.begin(), objects.end());
+    files.insert(files.end(), units.begin(), units.end());
+    Linker(llvm::Triple(llvm::sys::getDefaultTargetTriple())).link(files, output);
+
+    // Objects of older versions would only pile up
+    std::error_code errorCode;
+    for (llvm::sys::fs::directory_iterator it(m_directory, errorCode), end; !errorCode && it != end;
+         it.increment(errorCode))
+        if (llvm::StringRef(it->path()).endswith(objectSuffix) && !objects.count(it->path()))
+            llvm::sys::fs::remove(it->path());
+}
@@ -0,0 +1,375 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/JIT.h"
+#include "../include/Exception.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <cstdio>
+
+
+// Turns an LLVM error into our exception
+template<typename T>
+T check(llvm::Expected<T> value) {
+    if (!value)
+        throw Exception(llvm::toString(value.takeError()));
+    return std::move(*value);
+}
+
+static void check(llvm::Error error) {
+    if (error)
+        throw Exception(llvm::toString(std::move(error)));
+}
+
+JIT::JIT(Options options) : m_options(std::move(options)) {}
+
+JIT::~JIT() {
+    stop_background();
+}
+
+llvm::orc::JITTargetMachineBuilder JIT::target_builder(const Options& options) {
+    auto targetBuilder = check(llvm::orc::JITTargetMachineBuilder::detectHost());
+    if (options.cpu != "native" && options.cpu != "generic")
+        targetBuilder.setCPU(options.cpu);
+    if (!options.features.empty()) {
+        std::vector<std::string> features;
+        llvm::SubtargetFeatures::Split(features, options.features);
+        targetBuilder.addFeatures(features);
+    }
+    switch (options.optLevel) {
+        case OPT_0: targetBuilder.setCodeGenOptLevel(llvm::CodeGenOpt::None); break;
+        case OPT_1: targetBuilder.setCodeGenOptLevel(llvm::CodeGenOpt::Less); break;
+        case OPT_3: targetBuilder.setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive); break;
+        default: targetBuilder.setCodeGenOptLevel(llvm::CodeGenOpt::Default); break;
+    }
+    return targetBuilder;
+}
+
+std::unique_ptr<llvm::orc::LLJIT> JIT::create_session(const Options& options) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    auto jit = check(llvm::orc::LLJITBuilder().setJITTargetMachineBuilder(target_builder(options)).create());
+    // printf, scanf etc. come from this process
+    jit->getMainJITDylib().addGenerator(check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            jit->getDataLayout().getGlobalPrefix())));
+    return jit;
+}
+
+std::unique_ptr<llvm::orc::LLJIT> JIT::create_jit() {
+    auto jit = create_session(m_options);
+    for (const auto& object : m_objects) {
+        auto buffer = llvm::MemoryBuffer::getFile(object);
+        if (!buffer)
+            throw Exception("Cannot read " + object + ": " + buffer.getError().message());
+        check(jit->addObjectFile(std::move(*buffer)));
+    }
+    return jit;
+}
+
+int JIT::run(llvm::orc::ThreadSafeModule module) {
+    auto start = std::chrono::steady_clock::now();
+    m_jit = create_jit();
+    m_recompiled = 0;
+    m_warnings.clear();
+    if (m_options.tiered) {
+        module.withModuleDo([this](llvm::Module& m) { prepare_tiers(m); });
+        auto callback = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&tier_up),
+                                                 llvm::JITSymbolFlags::Exported);
+        check(m_jit->getMainJITDylib().define(llvm::orc::absoluteSymbols({
+            {m_jit->mangleAndIntern("__mila_tier_up"), callback}})));
+    }
+    check(m_jit->addIRModule(std::move(module)));
+    auto mainSymbol = check(m_jit->lookup("main"));
+
+    if (m_options.tiered) {
+        m_stopping = false;
+        m_background = std::thread(&JIT::background, this);
+    }
+    auto status = execute(mainSymbol, start);
+    stop_background();
+    return status;
+}
+
+// Compiles one function on its first call
+class FunctionUnit : public llvm::orc::MaterializationUnit {
+public:
+    FunctionUnit(llvm::orc::LLJIT& jit, std::string name, JIT::ModuleFactory factory, std::atomic<unsigned>& count) :
+            MaterializationUnit(Interface(
+                    {{jit.mangleAndIntern(name + ".impl"),
+                      llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable}}, nullptr)),
+            m_jit(jit),
+            m_name(std::move(name)),
+            m_factory(std::move(factory)),
+            m_count(count) {}
+
+    llvm::StringRef getName() const override { return m_name; }
+
+private:
+    void materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility> responsibility) override {
+        llvm::orc::ThreadSafeModule module;
+        try {
+            module = m_factory(m_name);
+        } catch (Exception& e) {
+            auto message = m_name + ": " + e.message();
+            if (e.has_position())
+                message = "LINE " + std::to_string(e.position().line) + "; COLUMN " +
+                          std::to_string(e.position().column) + ": " + message;
+            m_jit.getExecutionSession().reportError(
+                    llvm::make_error<llvm::StringError>(message, llvm::inconvertibleErrorCode()));
+            responsibility->failMaterialization();
+            return;
+        }
+        module.withModuleDo([this](llvm::Module& m) {
+            // Calls to itself stay direct, calls to others go through their stubs
+            m.getFunction(m_name)->setName(m_name + ".impl");
+            if (m.getDataLayout().isDefault())
+                m.setDataLayout(m_jit.getDataLayout());
+        });
+        m_count++;
+        m_jit.getIRTransformLayer().emit(std::move(responsibility), std::move(module));
+    }
+
+    void discard(const llvm::orc::JITDylib&, const llvm::orc::SymbolStringPtr&) override {}
+
+    llvm::orc::LLJIT& m_jit;
+    const std::string m_name;
+    JIT::ModuleFactory m_factory;
+    std::atomic<unsigned>& m_count;
+};
+
+// The call that needed the function cannot return, only the reported error has said why
+static void lazy_compilation_failed() {
+    std::fflush(stdout);
+    llvm::report_fatal_error("Cannot compile a function on its first call", false);
+}
+
+int JIT::run_lazy(llvm::orc::ThreadSafeModule main, const std::vector<std::string>& functions,
+                  ModuleFactory factory) {
+    auto start = std::chrono::steady_clock::now();
+    m_jit = create_jit();
+    m_lazilyCompiled = 0;
+
+    // Bodies live in their own dylib under name.impl, the main one only has stubs pointing there.
+    // The stubs are thread safe: concurrent first calls wait for a single compilation.
+    auto& session = m_jit->getExecutionSession();
+    session.setErrorReporter([](llvm::Error error) {
+        std::fflush(stdout);
+        llvm::report_fatal_error(llvm::Twine(llvm::toString(std::move(error))), false);
+    });
+    auto triple = m_jit->getTargetTriple();
+    m_callThrough = check(llvm::orc::createLocalLazyCallThroughManager(
+            triple, session, llvm::pointerToJITTargetAddress(&lazy_compilation_failed)));
+    m_stubs = llvm::orc::createLocalIndirectStubsManagerBuilder(triple)();
+
+    auto& bodies = session.createBareJITDylib("bodies");
+    bodies.addToLinkOrder(m_jit->getMainJITDylib());
+    llvm::orc::SymbolAliasMap stubs;
+    for (const auto& name : functions) {
+        check(bodies.define(std::make_unique<FunctionUnit>(*m_jit, name, factory, m_lazilyCompiled)));
+        stubs[m_jit->mangleAndIntern(name)] = llvm::orc::SymbolAliasMapEntry(
+                m_jit->mangleAndIntern(name + ".impl"),
+                llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    }
+    check(m_jit->getMainJITDylib().define(
+            llvm::orc::lazyReexports(*m_callThrough, *m_stubs, bodies, std::move(stubs))));
+
+    check(m_jit->addIRModule(std::move(main)));
+    return execute(check(m_jit->lookup("main")), start);
+}
+
+int JIT::execute(llvm::JITEvaluatedSymbol main, std::chrono::steady_clock::time_point start) {
+    auto compiled = std::chrono::steady_clock::now();
+    auto mainFunction = reinterpret_cast<int (*)()>(main.getAddress());
+    int status = mainFunction();
+    std::fflush(stdout);
+    auto finished = std::chrono::steady_clock::now();
+
+    m_compileTime = std::chrono::duration<double, std::milli>(compiled - start).count();
+    m_executionTime = std::chrono::duration<double, std::milli>(finished - compiled).count();
+    return status;
+}
+
+void JIT::prepare_tiers(llvm::Module& module) {
+    // Optimized versions live in their own modules and have to link against these
+    for (auto& function : module)
+        if (!function.isDeclaration() && function.hasLocalLinkage())
+            function.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    for (auto& global : module.globals())
+        if (!global.isDeclaration() && global.hasLocalLinkage() && !global.isConstant())
+            global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+    m_functions.clear();
+    for (auto& function : module)
+        if (!function.isDeclaration() && function.getName() != "main")
+            m_functions.push_back(function.getName().str());
+
+    llvm::raw_string_ostream bitcode(m_bitcode);
+    llvm::WriteBitcodeToFile(module, bitcode);
+    bitcode.flush();
+
+    for (unsigned i = 0; i < m_functions.size(); i++) {
+        auto function = module.getFunction(m_functions[i]);
+        auto pointer = new llvm::GlobalVariable(module, function->getType(), false,
+                                                llvm::GlobalValue::ExternalLinkage, function,
+                                                m_functions[i] + ".ptr");
+        route_calls(function, pointer);
+        count_calls(function, i);
+    }
+}
+
+// Makes every direct call to the callee load its address from the pointer instead
+void JIT::route_calls(llvm::Function* callee, llvm::GlobalVariable* pointer) {
+    std::vector<llvm::CallInst*> calls;
+    for (auto user : callee->users())
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(user))
+            if (call->getCalledOperand() == callee)
+                calls.push_back(call);
+
+    for (auto call : calls) {
+        llvm::IRBuilder<> builder(call);
+        auto target = builder.CreateLoad(callee->getType(), pointer, callee->getName() + ".target");
+        target->setAtomic(llvm::AtomicOrdering::Monotonic);
+        target->setAlignment(llvm::Align(sizeof(void*)));
+        call->setCalledOperand(target);
+    }
+}
+
+// Counts calls in the prologue and reports the function once it reaches the threshold
+void JIT::count_calls(llvm::Function* function, unsigned index) {
+    auto module = function->getParent();
+    auto& context = module->getContext();
+    auto int64 = llvm::Type::getInt64Ty(context);
+    auto counter = new llvm::GlobalVariable(*module, int64, false, llvm::GlobalValue::InternalLinkage,
+                                            llvm::ConstantInt::get(int64, 0), function->getName() + ".calls");
+
+    auto& entry = function->getEntryBlock();
+    auto body = entry.begin();
+    while (llvm::isa<llvm::AllocaInst>(*body))
+        ++body;
+    auto rest = entry.splitBasicBlock(body, "tier.body");
+    entry.getTerminator()->eraseFromParent();
+    auto hot = llvm::BasicBlock::Create(context, "tier.up", function, rest);
+
+    llvm::IRBuilder<> builder(&entry);
+    auto calls = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, llvm::ConstantInt::get(int64, 1),
+                                         llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+    builder.CreateCondBr(builder.CreateICmpEQ(calls, llvm::ConstantInt::get(int64, m_options.tierThreshold - 1)),
+                         hot, rest);
+
+    builder.SetInsertPoint(hot);
+    auto int32 = builder.getInt32Ty();
+    auto bytePointer = builder.getInt8PtrTy();
+    auto callback = module->getOrInsertFunction(
+            "__mila_tier_up", llvm::FunctionType::get(builder.getVoidTy(), {bytePointer, int32}, false));
+    auto self = llvm::ConstantExpr::getIntToPtr(builder.getInt64(reinterpret_cast<uint64_t>(this)), bytePointer);
+    builder.CreateCall(callback, {self, builder.getInt32(index)});
+    builder.CreateBr(rest);
+}
+
+// Called from generated code, must not block on compilation
+void JIT::tier_up(JIT* jit, unsigned index) {
+    {
+        std::lock_guard<std::mutex> lock(jit->m_mutex);
+        jit->m_hot.push_back(index);
+    }
+    jit->m_wakeUp.notify_one();
+}
+
+void JIT::background() {
+    while (true) {
+        unsigned index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this] { return m_stopping || !m_hot.empty(); });
+            if (m_stopping)
+                return;
+            index = m_hot.front();
+            m_hot.pop_front();
+        }
+        try {
+            recompile(index);
+        } catch (Exception& e) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_warnings.push_back("Cannot recompile " + m_functions[index] + ": " + e.message());
+        }
+    }
+}
+
+void JIT::stop_background() {
+    if (!m_background.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_one();
+    m_background.join();
+}
+
+// Builds an -O3 module holding only the hot function and swaps its pointer
+void JIT::recompile(unsigned index) {
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto buffer = llvm::MemoryBuffer::getMemBuffer(m_bitcode, "tier", false);
+    auto module = check(llvm::parseBitcodeFile(buffer->getMemBufferRef(), *context));
+
+    const auto& name = m_functions[index];
+    auto function = module->getFunction(name);
+    function->setName(name + ".opt");
+
+    // Everything else is already in the JIT, calls to it still go through the pointers
+    for (auto& other : *module)
+        if (&other != function && !other.isDeclaration()) {
+            other.deleteBody();
+            other.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    for (auto& global : module->globals())
+        if (!global.isDeclaration() && !global.hasLocalLinkage()) {
+            global.setInitializer(nullptr);
+            global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    for (const auto& otherName : m_functions) {
+        auto other = module->getFunction(otherName);
+        if (!other || other == function)
+            continue;
+        auto pointer = new llvm::GlobalVariable(*module, other->getType(), false,
+                                                llvm::GlobalValue::ExternalLinkage, nullptr, otherName + ".ptr");
+        route_calls(other, pointer);
+    }
+
+    // The CPU and features of tier 1, only optimized harder
+    auto targetBuilder = target_builder(m_options);
+    targetBuilder.setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+    auto targetMachine = check(targetBuilder.createTargetMachine());
+    module->setDataLayout(m_jit->getDataLayout());
+
+    llvm::LoopAnalysisManager loopAnalysis;
+    llvm::FunctionAnalysisManager functionAnalysis;
+    llvm::CGSCCAnalysisManager cgsccAnalysis;
+    llvm::ModuleAnalysisManager moduleAnalysis;
+
+    llvm::PassBuilder passBuilder(targetMachine.get());
+    passBuilder.registerModuleAnalyses(moduleAnalysis);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysis);
+    passBuilder.registerFunctionAnalyses(functionAnalysis);
+    passBuilder.registerLoopAnalyses(loopAnalysis);
+    passBuilder.crossRegisterProxies(loopAnalysis, functionAnalysis, cgsccAnalysis, moduleAnalysis);
+    passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3).run(*module, moduleAnalysis);
+
+    check(m_jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context))));
+    auto optimized = check(m_jit->lookup(name + ".opt"));
+    auto pointer = check(m_jit->lookup(name + ".ptr"));
+    __atomic_store_n(reinterpret_cast<uint64_t*>(pointer.getAddress()), optimized.getAddress(), __ATOMIC_RELEASE);
+    m_recompiled++;
+}
@@ -0,0 +1,123 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/Kernel.h"
+#include "../include/CodeGenerator.h"
+#include "../include/Exception.h"
+#include "../include/JIT.h"
+#include "../include/Parser.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+
+#include <cstdint>
+#include <sstream>
+
+
+template<typename T>
+static T check(llvm::Expected<T> value) {
+    if (!value)
+        throw Exception(llvm::toString(value.takeError()));
+    return std::move(*value);
+}
+
+// As the host would write it
+static std::string signature(TokenType result, const std::vector<TokenType>& args) {
+    auto name = [](TokenType type) -> std::string {
+        switch (type) {
+            case TOK_INTEGER: return "int";
+            case TOK_DOUBLE: return "double";
+            case TOK_VOID: return "void";
+            default: return "?";
+        }
+    };
+    std::string text = name(result) + '(';
+    for (size_t i = 0; i < args.size(); i++)
+        text += (i ? ", " : "") + name(args[i]);
+    return text + ')';
+}
+
+Kernel::Kernel(const std::string& source, Options options) : Kernel(source, std::move(options), Output()) {}
+
+Kernel::Kernel(const std::string& source, Options options, Output output) {
+    std::istringstream stream(source);
+    Parser parser(stream);
+    parser.parse();
+    m_tree = parser.get_tree();
+    if (std::dynamic_pointer_cast<UnitExpression>(m_tree) || !m_tree->uses().empty())
+        throw Exception("A kernel is a single program, it cannot be or use a unit");
+
+    // Every function has to stay, the host may look up any of them
+    options.wholeProgram = options.tiered = options.lazy = false;
+    CodeGenerator generator(m_tree, options);
+    generator.generate_code();
+    // Before optimizing, so the callbacks get inlined into the writes
+    redirect_output(*generator.module(), output);
+    generator.optimize();
+
+    m_jit = JIT::create_session(options);
+    if (auto error = m_jit->addIRModule(generator.take_module()))
+        throw Exception(llvm::toString(std::move(error)));
+}
+
+// The write helpers call the host instead of printf
+void Kernel::redirect_output(llvm::Module& module, const Output& output) {
+    auto& context = module.getContext();
+    auto pointer = [](llvm::IRBuilder<>& builder, const void* address, llvm::Type* type) {
+        return builder.CreateIntToPtr(builder.getInt64(reinterpret_cast<uintptr_t>(address)), type);
+    };
+    auto redirect = [&](const char* helper, void (*callback)(), bool newline) {
+        auto function = module.getFunction(helper);
+        if (!function || !callback)
+            return;
+        function->deleteBody();
+        function->setLinkage(llvm::GlobalValue::InternalLinkage);
+        llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "start", function));
+        auto type = llvm::FunctionType::get(builder.getVoidTy(), {builder.getInt8PtrTy(),
+                                            function->getArg(0)->getType(), builder.getInt8Ty()}, false);
+        auto call = builder.CreateCall(type, pointer(builder, reinterpret_cast<const void*>(callback),
+                                                     type->getPointerTo()),
+                                       {pointer(builder, output.context, builder.getInt8PtrTy()),
+                                        function->getArg(0), builder.getInt8(newline)});
+        call->addParamAttr(2, llvm::Attribute::ZExt);
+        builder.CreateRetVoid();
+    };
+    redirect("writeInt", reinterpret_cast<void (*)()>(output.integer), false);
+    redirect("writeLnInt", reinterpret_cast<void (*)()>(output.integer), true);
+    redirect("writeDouble", reinterpret_cast<void (*)()>(output.real), false);
+    redirect("writeLnDouble", reinterpret_cast<void (*)()>(output.real), true);
+
+    // What still calls printf writes a string
+    auto printf = module.getFunction("printf");
+    if (!printf || !output.text)
+        return;
+    std::vector<llvm::CallInst*> calls;
+    for (auto user : printf->users())
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(user))
+            if (call->getCalledFunction() == printf && call->arg_size() == 1)
+                calls.push_back(call);
+    for (auto call : calls) {
+        llvm::IRBuilder<> builder(call);
+        auto type = llvm::FunctionType::get(builder.getVoidTy(), {builder.getInt8PtrTy(), builder.getInt8PtrTy()},
+                                            false);
+        builder.CreateCall(type, pointer(builder, reinterpret_cast<const void*>(output.text), type->getPointerTo()),
+                           {pointer(builder, output.context, builder.getInt8PtrTy()), call->getArgOperand(0)});
+        // Its result, the number of characters printed, is never used
+        call->replaceAllUsesWith(llvm::UndefValue::get(call->getType()));
+        call->eraseFromParent();
+    }
+}
+
+void* Kernel::address(const std::string& name, TokenType result, const std::vector<TokenType>& args) {
+    std::shared_ptr<FunctionExpression> function;
+    for (const auto& candidate : m_tree->functions())
+        if (candidate->name() == name && candidate->body())
+            function = candidate;
+    if (!function)
+        throw Exception("No function " + name + " in the kernel");
+    if (function->return_type() != result || function->arg_types() != args)
+        throw Exception(name + " is " + signature(function->return_type(), function->arg_types()) +
+                        ", not " + signature(result, args));
+    return reinterpret_cast<void*>(check(m_jit->lookup(name)).getAddress());
+}
@@ -7,7 +7,6 @@
 #include "../include/Exception.h"
 #include "../include/Syntax.h"
 
-#include <iostream>
 #include <memory>
 #include <sstream>
 
@@ -33,7 +32,8 @@ int Lexer::read_char() {
 
 double Lexer::read_number(bool& isDouble) {
     std::string number(1, m_char);
-    while (std::isdigit(read_char()) || (!isDouble && (isDouble = (m_char == '.'))))
+    // '..' after an integer is a range, not a decimal point
+    while (std::isdigit(read_char()) || (!isDouble && m_char == '.' && m_stream.peek() != '.' && (isDouble = true)))
         number += m_char;
     return std::stod(number);
 }
@@ -43,7 +43,6 @@ int Lexer::read_hex() {
     while (std::isdigit(read_char()))
         reading << m_char;
     int result;
-    std::cout << reading.str() << std::endl;
     reading >> std::hex >> result;
     return result;
 }
@@ -135,6 +134,13 @@ std::shared_ptr<Token> Lexer::next_token() {
             return as_token<IntegerToken, int>(read_hex());
         case '&':
             return as_token<IntegerToken, int>(read_oct());
+        // '.' or '..'
+        case '.':
+            if (read_char() == '.') {
+                read_char();
+                return as_token<SimpleToken, TokenType>(TOK_RANGE);
+            }
+            return as_token<SimpleToken, TokenType>(TOK_DOT);
         // string
         case '\'':
             return as_token<StringToken, std::string>(read_string());
@@ -0,0 +1,138 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/Linker.h"
+#include "../include/Exception.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef MILA_HAS_LLD
+#include "lld/Common/CommonLinkerContext.h"
+#include "lld/Common/Driver.h"
+
+#include <mutex>
+#endif
+
+#include <cstdlib>
+
+
+Linker::Linker(const llvm::Triple& triple) : m_triple(triple) {
+    if (!m_triple.isOSLinux())
+        throw Exception("Linking is not supported for " + m_triple.str());
+
+    switch (m_triple.getArch()) {
+        case llvm::Triple::x86_64:
+            m_emulation = "elf_x86_64";
+            m_dynamicLinker = "/lib64/ld-linux-x86-64.so.2";
+            break;
+        case llvm::Triple::aarch64:
+            m_emulation = "aarch64linux";
+            m_dynamicLinker = "/lib/ld-linux-aarch64.so.1";
+            break;
+        default:
+            throw Exception("Linking is not supported for " + m_triple.str());
+    }
+
+    // Debian style multiarch first, then the usual fallbacks
+    auto multiarch = m_triple.getArchName().str() + "-linux-gnu";
+    m_libraryDirectories = {"/usr/lib/" + multiarch, "/lib/" + multiarch, "/usr/lib64", "/lib64", "/usr/lib"};
+}
+
+std::string Linker::find_file(const std::vector<std::string>& directories, const std::string& name) {
+    for (const auto& directory : directories) {
+        llvm::SmallString<128> path(directory);
+        llvm::sys::path::append(path, name);
+        if (llvm::sys::fs::exists(path))
+            return std::string(path.str());
+    }
+    return "";
+}
+
+// Where libgcc and crtbegin.o live, the newest version if there are several
+std::string Linker::gcc_directory() {
+    std::string best;
+    int bestVersion = -1;
+    auto multiarch = m_triple.getArchName().str() + "-linux-gnu";
+    for (const auto& root : {"/usr/lib/gcc/" + multiarch, "/usr/lib/gcc/" + m_triple.str()}) {
+        std::error_code errorCode;
+        for (llvm::sys::fs::directory_iterator it(root, errorCode), end; !errorCode && it != end;
+             it.increment(errorCode)) {
+            auto version = std::atoi(llvm::sys::path::filename(it->path()).str().c_str());
+            if (version > bestVersion && !find_file({it->path()}, "crtbegin.o").empty()) {
+                bestVersion = version;
+                best = it->path();
+            }
+        }
+    }
+    return best;
+}
+
+std::vector<std::string> Linker::arguments(const std::vector<std::string>& objects, const std::string& output) {
+    auto crt1 = find_file(m_libraryDirectories, "crt1.o");
+    auto crti = find_file(m_libraryDirectories, "crti.o");
+    auto crtn = find_file(m_libraryDirectories, "crtn.o");
+    if (crt1.empty() || crti.empty() || crtn.empty())
+        throw Exception("Cannot find the C runtime start files");
+    auto gcc = gcc_directory();
+
+    // What a driver passes for a non-PIE executable, the object code is not position independent
+    std::vector<std::string> args = {"ld", "-o", output, "-m", m_emulation, "--eh-frame-hdr",
+                                     "-dynamic-linker", m_dynamicLinker, crt1, crti};
+    if (!gcc.empty())
+        args.insert(args.end(), {gcc + "/crtbegin.o", "-L" + gcc});
+    for (const auto& directory : m_libraryDirectories)
+        args.push_back("-L" + directory);
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.insert(args.end(), {"-lm", "-lc"});
+    if (!gcc.empty())
+        args.insert(args.end(), {"-lgcc", "--as-needed", "-lgcc_s", "--no-as-needed", gcc + "/crtend.o"});
+    args.push_back(crtn);
+    return args;
+}
+
+void Linker::link(const std::vector<std::string>& objects, const std::string& output) {
+    auto args = arguments(objects, output);
+
+#ifdef MILA_HAS_LLD
+    std::vector<const char*> argv;
+    for (const auto& arg : args)
+        argv.push_back(arg.c_str());
+    std::string errors;
+    llvm::raw_string_ostream errorStream(errors);
+    // lld keeps its state in globals, batch jobs and server requests link one at a time
+    // and each starts from a fresh context, whether the one before it failed or not
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    bool linked = lld::elf::link(argv, llvm::outs(), errorStream, false, false);
+    lld::CommonLinkerContext::destroy();
+    if (!linked)
+        throw Exception("Linking failed: " + errorStream.str());
+#else
+    auto linker = llvm::sys::findProgramByName("ld.lld");
+    if (!linker)
+        linker = llvm::sys::findProgramByName("ld");
+    if (!linker)
+        throw Exception("Cannot find a linker");
+
+    // What the linker prints belongs in the error, not on the stderr of a batch or the server
+    llvm::SmallString<128> log;
+    if (llvm::sys::fs::createTemporaryFile("mila-link", "txt", log))
+        throw Exception("Cannot create a file for the linker's messages");
+    llvm::FileRemover remover(log);
+    llvm::Optional<llvm::StringRef> redirects[] = {llvm::StringRef(""), log.str(), log.str()};
+
+    std::vector<llvm::StringRef> argv(args.begin(), args.end());
+    std::string errors;
+    if (llvm::sys::ExecuteAndWait(*linker, argv, llvm::None, redirects, 0, 0, &errors) != 0) {
+        if (auto messages = llvm::MemoryBuffer::getFile(log))
+            errors += (errors.empty() ? "" : "\n") + (*messages)->getBuffer().rtrim().str();
+        throw Exception("Linking failed" + (errors.empty() ? std::string() : ": " + errors));
+    }
+#endif
+}
@@ -0,0 +1,205 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/ObjectCache.h"
+#include "../include/Exception.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+
+// Bump when the layout of the cache directory changes
+static const char* const cacheFormat = "mila-cache-1";
+static const char* const entrySuffix = ".bin";
+
+ObjectCache::ObjectCache(std::string directory, uint64_t maxSize) :
+        m_directory(std::move(directory)),
+        m_maxSize(maxSize) {
+    if (auto errorCode = llvm::sys::fs::create_directories(m_directory))
+        throw Exception("Cannot create the cache directory " + m_directory + ": " + errorCode.message());
+}
+
+std::string ObjectCache::default_directory() {
+    if (auto directory = std::getenv("MILA_CACHE_DIR"))
+        return directory;
+    llvm::SmallString<128> path;
+    if (!llvm::sys::path::cache_directory(path))
+        llvm::sys::path::system_temp_directory(true, path);
+    llvm::sys::path::append(path, "mila");
+    return std::string(path.str());
+}
+
+std::string ObjectCache::key(const std::string& source, const Options& options) {
+    // A rebuilt compiler gets a new key without anyone bumping a version
+    std::string compiler = LLVM_VERSION_STRING;
+    llvm::sys::fs::file_status status;
+    auto executable = llvm::sys::fs::getMainExecutable(nullptr, reinterpret_cast<void*>(&default_directory));
+    if (!llvm::sys::fs::status(executable, status))
+        compiler += ";" + std::to_string(status.getSize()) + ";" +
+                    std::to_string(status.getLastModificationTime().time_since_epoch().count());
+
+    auto cpu = options.cpu, features = options.features;
+    if (cpu == "native") {
+        cpu = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            std::vector<std::string> sorted;
+            for (const auto& feature : hostFeatures)
+                sorted.push_back((feature.second ? "+" : "-") + feature.first().str());
+            std::sort(sorted.begin(), sorted.end());
+            for (const auto& feature : sorted)
+                features += "," + feature;
+        }
+    }
+
+    llvm::SHA256 hash;
+    for (const auto& part : {std::string(cacheFormat), compiler, llvm::sys::getDefaultTargetTriple(), cpu, features,
+                             std::to_string(options.optLevel), options.multiversion,
+                             std::to_string(options.wholeProgram), std::to_string(options.ssa), source}) {
+        hash.update(part);
+        hash.update(llvm::StringRef("\0", 1));
+    }
+    return llvm::toHex(hash.result(), true);
+}
+
+std::string ObjectCache::entry(const std::string& key) const {
+    llvm::SmallString<128> path(m_directory);
+    llvm::sys::path::append(path, key + entrySuffix);
+    return std::string(path.str());
+}
+
+bool ObjectCache::fetch(const std::string& key, const std::string& output) {
+    auto path = entry(key);
+    // Evicted by another compiler in the meantime counts as a miss
+    bool hit = !llvm::sys::fs::copy_file(path, output);
+    if (hit) {
+        llvm::sys::fs::setPermissions(output, llvm::sys::fs::all_read | llvm::sys::fs::all_exe |
+                                              llvm::sys::fs::owner_write);
+        // The modification time orders entries for eviction
+        int fd;
+        if (!llvm::sys::fs::openFileForWrite(path, fd, llvm::sys::fs::CD_OpenExisting, llvm::sys::fs::OF_Append)) {
+            llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+            llvm::sys::fs::closeFile(fd);
+        }
+    }
+    count(hit);
+    return hit;
+}
+
+void ObjectCache::store(const std::string& key, const std::string& file) {
+    llvm::SmallString<128> temporary;
+    llvm::sys::fs::createUniquePath(m_directory + "/tmp-%%%%%%%%", temporary, false);
+    if (auto errorCode = llvm::sys::fs::copy_file(file, temporary))
+        throw Exception("Cannot write to the cache: " + errorCode.message());
+    if (auto errorCode = llvm::sys::fs::rename(temporary, entry(key))) {
+        llvm::sys::fs::remove(temporary);
+        throw Exception("Cannot write to the cache: " + errorCode.message());
+    }
+    locked([this]() { evict(); });
+}
+
+// Serializes updates of the counters and eviction between compilers
+void ObjectCache::locked(const std::function<void()>& action) {
+    int fd;
+    if (auto errorCode = llvm::sys::fs::openFileForWrite(m_directory + "/lock", fd, llvm::sys::fs::CD_OpenAlways))
+        throw Exception("Cannot lock the cache: " + errorCode.message());
+    if (auto errorCode = llvm::sys::fs::lockFile(fd)) {
+        llvm::sys::fs::closeFile(fd);
+        throw Exception("Cannot lock the cache: " + errorCode.message());
+    }
+    try {
+        action();
+    } catch (...) {
+        llvm::sys::fs::unlockFile(fd);
+        llvm::sys::fs::closeFile(fd);
+        throw;
+    }
+    llvm::sys::fs::unlockFile(fd);
+    llvm::sys::fs::closeFile(fd);
+}
+
+void ObjectCache::count(bool hit) {
+    locked([this, hit]() {
+        auto statistics = this->statistics();
+        (hit ? statistics.hits : statistics.misses)++;
+
+        llvm::SmallString<128> temporary;
+        llvm::sys::fs::createUniquePath(m_directory + "/tmp-%%%%%%%%", temporary, false);
+        {
+            std::error_code errorCode;
+            llvm::raw_fd_ostream stats(temporary, errorCode);
+            if (errorCode)
+                return;
+            stats << "hits " << statistics.hits << "\nmisses " << statistics.misses << '\n';
+        }
+        llvm::sys::fs::rename(temporary, m_directory + "/stats");
+    });
+}
+
+ObjectCache::Statistics ObjectCache::statistics() {
+    Statistics statistics;
+    if (auto buffer = llvm::MemoryBuffer::getFile(m_directory + "/stats")) {
+        std::istringstream stats((*buffer)->getBuffer().str());
+        std::string name;
+        uint64_t value;
+        while (stats >> name >> value) {
+            if (name == "hits")
+                statistics.hits = value;
+            else if (name == "misses")
+                statistics.misses = value;
+        }
+    }
+
+    std::error_code errorCode;
+    for (llvm::sys::fs::directory_iterator it(m_directory, errorCode), end; !errorCode && it != end;
+         it.increment(errorCode)) {
+        llvm::sys::fs::file_status status;
+        if (llvm::StringRef(it->path()).endswith(entrySuffix) && !llvm::sys::fs::status(it->path(), status)) {
+            statistics.entries++;
+            statistics.size += status.getSize();
+        }
+    }
+    return statistics;
+}
+
+// Drops the least recently used entries until the cache fits its limit
+void ObjectCache::evict() {
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        llvm::sys::TimePoint<> used;
+    };
+    std::vector<Entry> entries;
+    uint64_t size = 0;
+
+    std::error_code errorCode;
+    for (llvm::sys::fs::directory_iterator it(m_directory, errorCode), end; !errorCode && it != end;
+         it.increment(errorCode)) {
+        llvm::sys::fs::file_status status;
+        if (llvm::StringRef(it->path()).endswith(entrySuffix) && !llvm::sys::fs::status(it->path(), status)) {
+            entries.push_back({it->path(), status.getSize(), status.getLastModificationTime()});
+            size += status.getSize();
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const auto& old : entries) {
+        if (size <= m_maxSize)
+            break;
+        if (!llvm::sys::fs::remove(old.path))
+            size -= old.size;
+    }
+}
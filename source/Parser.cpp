@@ -24,11 +24,94 @@ std::string Parser::get_source() const {
 
 void Parser::parse() {
     std::string name = "Default";
-    if (next_token()->type() == TOK_PROGRAM)
+    if (next_token()->type() == TOK_UNIT) {
+        m_tree = parse_unit();
+        return;
+    }
+    if (last_token()->type() == TOK_PROGRAM)
         name = parse_program_name();
     m_tree = parse_top_level();
 }
 
+std::list<std::string> Parser::parse_uses() {
+    std::list<std::string> units;
+    do {
+        if (next_token()->type() != TOK_IDENTIFIER)
+            throw Exception(std::move(position()), "Expected a unit name");
+        units.push_back(last_token()->to_string());
+    } while (next_token()->type() == TOK_COMMA);
+    if (last_token()->type() != TOK_SEMICOLON)
+        throw ExpectedDifferentException(std::move(position()), ";");
+    next_token();
+    return units;
+}
+
+std::shared_ptr<UnitExpression> Parser::parse_unit() {
+    auto unitPosition = position();
+    if (next_token()->type() != TOK_IDENTIFIER)
+        throw Exception(std::move(position()), "Expected an identifier");
+    m_programName = last_token()->to_string();
+    if (next_token()->type() != TOK_SEMICOLON)
+        throw ExpectedDifferentException(std::move(position()), ";");
+    if (next_token()->type() != TOK_INTERFACE)
+        throw ExpectedDifferentException(std::move(position()), "interface");
+    next_token();
+
+    auto consts = std::make_shared<ConstExpression>(position());
+    auto vars = std::make_shared<VarExpression>(position());
+    std::list<std::shared_ptr<FunctionExpression>> functions;
+    std::list<std::string> uses;
+    std::set<std::string> exports;
+    bool interface = true;
+    while (true) {
+        switch (last_token()->type()) {
+            case TOK_USES:
+                uses.splice(uses.end(), parse_uses());
+                break;
+            case TOK_CONST: {
+                auto c = parse_const();
+                if (interface)
+                    for (const auto& constant : c->consts())
+                        exports.insert(constant.first);
+                consts->add(c);
+                break;
+            }
+            case TOK_VAR: {
+                auto v = parse_var();
+                if (interface)
+                    for (const auto& var : v->vars())
+                        exports.insert(var.first);
+                vars->add(v);
+                break;
+            }
+            case TOK_FUNCTION:
+            case TOK_PROCEDURE:
+                functions.push_back(parse_function(last_token()->type() == TOK_PROCEDURE, interface));
+                if (interface)
+                    exports.insert(functions.back()->name());
+                break;
+            case TOK_IMPLEMENTATION:
+                if (!interface)
+                    throw UnexpectedTokenException(std::move(position()), "implementation");
+                interface = false;
+                next_token();
+                break;
+            case TOK_SEMICOLON:
+                next_token();
+                break;
+            case TOK_END:
+                if (interface)
+                    throw ExpectedDifferentException(std::move(position()), "implementation");
+                if (next_token()->type() != TOK_DOT)
+                    throw ExpectedDifferentException(std::move(position()), ".");
+                return std::make_shared<UnitExpression>(m_programName, exports, functions, consts, vars,
+                                                        unitPosition, uses);
+            default:
+                throw UnexpectedTokenException(std::move(position()), last_token()->to_string());
+        }
+    }
+}
+
 std::string Parser::parse_program_name() {
     if (next_token()->type() != TOK_IDENTIFIER)
         throw Exception(std::move(position()), "Expected an identifier");
@@ -93,13 +176,15 @@ std::shared_ptr<TopLevelExpression> Parser::parse_top_level() {
     std::shared_ptr<ConstExpression> constExpr = nullptr;
     std::shared_ptr<VarExpression> varExpr = nullptr;
     std::list<std::shared_ptr<FunctionExpression>> functions;
+    std::list<std::string> uses;
     while (last_token()->type() != TOK_EOF) {
         switch (last_token()->type()) {
             default:
                 throw UnexpectedTokenException(std::move(position()), last_token()->to_string());
             case TOK_BEGIN: {
                 auto block = std::make_shared<TopLevelExpression>(functions, constExpr, varExpr,
-                                                                  std::move(parse_block()), std::move(position()));
+                                                                  std::move(parse_block()), std::move(position()),
+                                                                  uses);
                 if (last_token()->type() != TOK_DOT)
                     throw ExpectedDifferentException(std::move(position()), ".");
                 return block;
@@ -116,6 +201,9 @@ std::shared_ptr<TopLevelExpression> Parser::parse_top_level() {
                 else
                     varExpr->add(parse_var());
                 break;
+            case TOK_USES:
+                uses.splice(uses.end(), parse_uses());
+                break;
             case TOK_FUNCTION:
                 functions.push_back(parse_function(false));
                 break;
@@ -239,12 +327,15 @@ ExpressionPointer Parser::parse_single() {
             return std::move(parse_parentheses());
         case TOK_IF:
             return std::move(parse_condition());
+        case TOK_CASE:
+            return std::move(parse_case());
         case TOK_WHILE:
             return std::move(parse_while());
         case TOK_FOR:
             return std::move(parse_for());
         case TOK_MINUS:
-            return std::move(parse_minus());
+        case TOK_NOT:
+            return std::move(parse_unary());
         case TOK_BREAK:
             return std::move(parse_break());
         case TOK_EXIT:
@@ -258,7 +349,7 @@ ExpressionPointer Parser::parse_single() {
     return ExpressionPointer();
 }
 
-std::shared_ptr<FunctionExpression> Parser::parse_function(bool procedure) {
+std::shared_ptr<FunctionExpression> Parser::parse_function(bool procedure, bool header) {
     if (next_token()->type() != TOK_IDENTIFIER)
         throw Exception(std::move(position()), "Function name expected");
     std::string name = last_token()->to_string();
@@ -300,6 +391,12 @@ std::shared_ptr<FunctionExpression> Parser::parse_function(bool procedure) {
         type = TOK_VOID;
     if (next_token()->type() != TOK_SEMICOLON)
         throw ExpectedDifferentException(std::move(position()), ";");
+    if (header) {
+        next_token();
+        return std::make_shared<FunctionExpression>(name, type, args, std::make_shared<ConstExpression>(position()),
+                                                    std::make_shared<VarExpression>(position()), nullptr,
+                                                    std::move(position()));
+    }
 
     bool parsingLocals = true;
     auto consts = std::make_shared<ConstExpression>(std::move(position()));
@@ -355,6 +452,59 @@ std::shared_ptr<ConditionExpression> Parser::parse_condition() {
     return std::make_shared<ConditionExpression>(condition, ifTrue, ifFalse, std::move(position()));
 }
 
+std::shared_ptr<CaseExpression> Parser::parse_case() {
+    next_token();
+    auto selector = parse_expression();
+    if (!selector || !selector->can_be_operand())
+        throw Exception(std::move(position()), "Invalid case selector");
+    if (last_token()->type() != TOK_OF)
+        throw ExpectedDifferentException(std::move(position()), "of");
+    next_token();
+
+    std::list<CaseBranch> branches;
+    ExpressionPointer otherwise = nullptr;
+    while (last_token()->type() != TOK_END) {
+        if (last_token()->type() == TOK_ELSE) {
+            next_token();
+            otherwise = parse_expression();
+            if (last_token()->type() == TOK_SEMICOLON)
+                next_token();
+            if (last_token()->type() != TOK_END)
+                throw ExpectedDifferentException(std::move(position()), "end");
+            break;
+        }
+        // v1, v2, lo..hi: body
+        CaseBranch branch;
+        while (true) {
+            auto low = parse_expression();
+            if (!low || !low->can_be_operand())
+                throw Exception(std::move(position()), "Invalid case label");
+            ExpressionPointer high = nullptr;
+            if (last_token()->type() == TOK_RANGE) {
+                next_token();
+                high = parse_expression();
+                if (!high || !high->can_be_operand())
+                    throw Exception(std::move(position()), "Invalid case label");
+            }
+            branch.labels.push_back({low, high});
+            if (last_token()->type() != TOK_COMMA)
+                break;
+            next_token();
+        }
+        if (last_token()->type() != TOK_COLON)
+            throw ExpectedDifferentException(std::move(position()), ":");
+        next_token();
+        branch.body = parse_expression();
+        branches.push_back(std::move(branch));
+        if (last_token()->type() == TOK_SEMICOLON)
+            next_token();
+        else if (last_token()->type() != TOK_END && last_token()->type() != TOK_ELSE)
+            throw ExpectedDifferentException(std::move(position()), ";");
+    }
+    next_token();
+    return std::make_shared<CaseExpression>(selector, branches, otherwise, std::move(position()));
+}
+
 std::shared_ptr<WhileLoopExpression> Parser::parse_while() {
     next_token();
     auto condition = parse_expression();
@@ -402,12 +552,23 @@ std::shared_ptr<ForLoopExpression> Parser::parse_for() {
     return std::make_shared<ForLoopExpression>(counter, start, finish, downto, body, std::move(position()));
 }
 
-std::shared_ptr<BinaryOperationExpression> Parser::parse_minus() {
+ExpressionPointer Parser::parse_unary() {
+    auto op = last_token()->type();
     next_token();
-    static const auto multiply = std::make_shared<OperatorToken>(TOK_MULTIPLY);
-    static const auto minusOne = std::make_shared<IntegerExpression>(-1, std::move(position()));
-    auto expr = parse_expression();
-    return std::make_shared<BinaryOperationExpression>(multiply, minusOne, expr, false, std::move(position()));
+    // Unary operators bind tighter than any binary one
+    auto operand = parse_single();
+    if (!operand || !operand->can_be_operand())
+        throw Exception(std::move(position()), "Invalid operand");
+    if (op == TOK_MINUS) {
+        // Fold negative literals right away
+        if (operand->type() == EXPR_INTEGER)
+            return std::make_shared<IntegerExpression>(
+                    -std::static_pointer_cast<IntegerExpression>(operand)->value(), std::move(position()));
+        if (operand->type() == EXPR_DOUBLE)
+            return std::make_shared<DoubleExpression>(
+                    -std::static_pointer_cast<DoubleExpression>(operand)->value(), std::move(position()));
+    }
+    return std::make_shared<UnaryOperationExpression>(op, operand, std::move(position()));
 }
 
 std::shared_ptr<TopLevelExpression> Parser::get_tree() const {
@@ -0,0 +1,182 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/Server.h"
+#include "../include/CodeGenerator.h"
+#include "../include/Driver.h"
+#include "../include/Exception.h"
+#include "../include/Options.h"
+#include "../include/ServerProtocol.h"
+
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sstream>
+
+#include <sys/time.h>
+#include <sys/un.h>
+
+
+// No command line comes near it, a request that claims more is broken
+static const unsigned MAX_ARGS = 4096;
+// Seconds a client may take to send its request
+static const int REQUEST_TIMEOUT = 30;
+
+// For the signal handler, which cannot take arguments
+static std::string g_socket;
+
+static void stop(int) {
+    unlink(g_socket.c_str());
+    _exit(0);
+}
+
+// What LLVM reported before a request was abandoned
+static thread_local std::string t_fatalError;
+
+// report_fatal_error would exit, in a request it only ends that request
+static void fatal_error(void*, const char* reason, bool) {
+    if (auto recovery = llvm::CrashRecoveryContext::GetCurrent()) {
+        t_fatalError = reason;
+        recovery->HandleExit(1);
+    }
+    std::cerr << "LLVM ERROR: " << reason << std::endl;
+}
+
+Server::Server(std::string socket, unsigned threads) :
+        m_socket(std::move(socket)),
+        m_threads(threads) {}
+
+void Server::serve() {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (m_socket.size() >= sizeof(address.sun_path))
+        throw Exception("Socket path too long: " + m_socket);
+    std::strcpy(address.sun_path, m_socket.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw Exception(std::string("Cannot create a socket: ") + std::strerror(errno));
+    // A socket file nobody listens on is left over from a killed server
+    if (connect(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+        throw Exception("A server is already listening on " + m_socket);
+    close(listener);
+    unlink(m_socket.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+        listen(listener, SOMAXCONN))
+        throw Exception("Cannot listen on " + m_socket + ": " + std::strerror(errno));
+
+    g_socket = m_socket;
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Paid once here instead of by the first request
+    CodeGenerator::initialize_targets();
+    llvm::CrashRecoveryContext::Enable();
+    llvm::install_fatal_error_handler(fatal_error);
+    std::cerr << "Listening on " << m_socket << std::endl;
+
+    llvm::ThreadPool pool(llvm::hardware_concurrency(m_threads));
+    while (true) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            auto error = std::string(std::strerror(errno));
+            close(listener);
+            unlink(m_socket.c_str());
+            throw Exception("Cannot accept a connection: " + error);
+        }
+        // A client that connects and sends nothing must not keep a thread forever
+        timeval timeout = {REQUEST_TIMEOUT, 0};
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        pool.async([this, connection]() {
+            handle(connection);
+            close(connection);
+        });
+    }
+}
+
+
+void Server::handle(int connection) {
+    std::ostringstream out, err;
+    int status = 1;
+    // Whatever a request does, it must not take the server down for everyone else
+    try {
+        std::string directory, count, source;
+        if (!receive_message(connection, directory) || !receive_message(connection, count))
+            return;
+        unsigned size;
+        if (!Options::parse_unsigned(count, size) || size > MAX_ARGS)
+            throw Exception("Malformed request: " + count + " arguments");
+        std::vector<std::string> args(size);
+        for (auto& arg : args)
+            if (!receive_message(connection, arg))
+                return;
+        if (!receive_message(connection, source))
+            return;
+
+        Options options;
+        for (const auto& arg : args)
+            if (arg.size() > 1 && arg[0] == '-')
+                options.parse(arg);
+        if (options.run || options.vm)
+            err << "ERROR:\t--run, --tiered, --lazy and --vm are not served, run the compiler itself" << std::endl;
+        else {
+            // An LLVM fatal error or a crash ends this request, not the server
+            t_fatalError.clear();
+            llvm::CrashRecoveryContext recovery;
+            if (!recovery.RunSafely([&]() {
+                status = Driver("mila-client", out, err).run(resolve(directory, args), source);
+            })) {
+                err << "ERROR:\t" << (t_fatalError.empty() ? "The compiler crashed" : t_fatalError) << std::endl;
+                status = 3;
+            }
+        }
+    } catch (Exception& e) {
+        err << "ERROR:\t" << e.message() << std::endl;
+        status = 1;
+    } catch (std::exception& e) {
+        err << "ERROR:\t" << e.what() << std::endl;
+        status = 1;
+    }
+
+    // A client gone in the meantime is no error of the server's
+    if (send_message(connection, std::to_string(status)) && send_message(connection, out.str()))
+        send_message(connection, err.str());
+}
+
+// The server's working directory is not the client's
+std::vector<std::string> Server::resolve(const std::string& directory, std::vector<std::string> args) {
+    auto absolute = [&directory](const std::string& path) {
+        llvm::SmallString<128> resolved(path);
+        llvm::sys::fs::make_absolute(directory, resolved);
+        return std::string(resolved.str());
+    };
+    unsigned positional = 0;
+    for (auto& arg : args) {
+        if (arg.size() <= 1 || arg[0] != '-') {
+            arg = absolute(arg);
+            positional++;
+        }
+        else if (arg.rfind("-I", 0) == 0)
+            arg = "-I" + absolute(arg.substr(2));
+        else if (arg.rfind("--cache-dir=", 0) == 0)
+            arg = "--cache-dir=" + absolute(arg.substr(12));
+    }
+    // The default output too
+    if (positional == 1)
+        args.push_back(absolute("output"));
+    return args;
+}
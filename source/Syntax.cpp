@@ -43,7 +43,14 @@ TokenType Syntax::check_keyword(const std::string &word) {
                                                               {"exit", TOK_EXIT},
                                                               {"procedure", TOK_PROCEDURE},
                                                               {"double", TOK_DOUBLE},
-                                                              {"forward", TOK_FORWARD}};
+                                                              {"forward", TOK_FORWARD},
+                                                              {"not", TOK_NOT},
+                                                              {"case", TOK_CASE},
+                                                              {"of", TOK_OF},
+                                                              {"unit", TOK_UNIT},
+                                                              {"uses", TOK_USES},
+                                                              {"interface", TOK_INTERFACE},
+                                                              {"implementation", TOK_IMPLEMENTATION}};
     auto it = keyWords.find(word);
     if (it != keyWords.end())
         return it->second;
@@ -58,10 +65,13 @@ bool Syntax::is_delimiter(const char del) {
 }
 
 TokenType Syntax::check_operator(const std::string &op) {
-    static std::map<std::string, TokenType> opMap;
-    if (opMap.empty())
+    // Filled once, thread safe
+    static const std::map<std::string, TokenType> opMap = []() {
+        std::map<std::string, TokenType> map;
         for (const Operator& op : g_operators)
-            opMap[op.name] = op.type;
+            map[op.name] = op.type;
+        return map;
+    }();
     auto it = opMap.find(op);
     if (it != opMap.end())
         return it->second;
@@ -74,10 +84,12 @@ bool Syntax::is_datatype(TokenType dt) {
 }
 
 bool Syntax::is_bool_operator(TokenType op) {
-    static std::set<TokenType> bool_ops;
-    if (bool_ops.empty())
+    static const std::set<TokenType> bool_ops = []() {
+        std::set<TokenType> ops;
         for (const auto& op : g_operators)
             if (op.is_boolean)
-                bool_ops.insert(op.type);
+                ops.insert(op.type);
+        return ops;
+    }();
     return bool_ops.count(op);
 }
@@ -8,10 +8,12 @@
 
 
 int OperatorToken::op_precedence() const {
-    static std::map<TokenType, int> precMap;
-    if (precMap.empty())
+    static const std::map<TokenType, int> precMap = []() {
+        std::map<TokenType, int> map;
         for (const auto& op : g_operators)
-            precMap[op.type] = op.precedence;
+            map[op.type] = op.precedence;
+        return map;
+    }();
     auto it = precMap.find(m_type);
     if (it == precMap.end())
         return -1;
@@ -19,10 +21,12 @@ int OperatorToken::op_precedence() const {
 }
 
 std::string OperatorToken::to_string() const {
-    static std::map<TokenType, const char*> opStrings;
-    if (opStrings.empty())
+    static const std::map<TokenType, const char*> opStrings = []() {
+        std::map<TokenType, const char*> map;
         for (const auto& op : g_operators)
-            opStrings[op.type] = op.name.c_str();
+            map[op.type] = op.name.c_str();
+        return map;
+    }();
     auto it = opStrings.find(m_type);
     if (it == opStrings.end())
         return "<?>";
@@ -0,0 +1,321 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/UnitBuilder.h"
+#include "../include/CodeGenerator.h"
+#include "../include/Exception.h"
+#include "../include/ObjectCache.h"
+#include "../include/Parser.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+
+// The first line of a summary names the options its object was compiled with
+static const std::string OPTIONS_LINE = "options ";
+
+static llvm::sys::TimePoint<> modified(const std::string& file) {
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(file, status))
+        return llvm::sys::TimePoint<>::min();
+    return status.getLastModificationTime();
+}
+
+// Errors inside a unit would otherwise point into the program's source
+static std::string located(const std::string& file, const TextPosition& position, const std::string& message) {
+    std::string location = file;
+    if (position.line)
+        location += ':' + std::to_string(position.line) + ':' + std::to_string(position.column);
+    return location + ": " + message;
+}
+
+// Writes through a temporary file, so a reader never sees half of it
+static void replace_file(const std::string& file, llvm::StringRef contents) {
+    llvm::SmallString<128> temporary;
+    llvm::sys::fs::createUniquePath(file + ".tmp-%%%%%%%%", temporary, false);
+    {
+        std::error_code errorCode;
+        llvm::raw_fd_ostream stream(temporary, errorCode);
+        if (errorCode)
+            throw Exception("Cannot write " + file + ": " + errorCode.message());
+        stream << contents;
+    }
+    if (auto errorCode = llvm::sys::fs::rename(temporary, file)) {
+        llvm::sys::fs::remove(temporary);
+        throw Exception("Cannot write " + file + ": " + errorCode.message());
+    }
+}
+
+// Of the summary's first line, empty for a summary without one
+static std::string recorded_options(const std::string& summary) {
+    std::ifstream stream(summary);
+    std::string line;
+    if (!std::getline(stream, line) || line.rfind(OPTIONS_LINE, 0) != 0)
+        return "";
+    return line.substr(OPTIONS_LINE.size());
+}
+
+UnitBuilder::UnitBuilder(Options options, std::vector<std::string> directories) :
+        m_options(std::move(options)),
+        m_directories(std::move(directories)) {
+    // Only the program is linked, each unit is optimized on its own
+    m_options.wholeProgram = false;
+    m_optionsKey = ObjectCache::key("", m_options);
+}
+
+std::shared_ptr<UnitExpression> UnitBuilder::parse(const std::string& file) {
+    std::ifstream stream(file);
+    if (stream.fail())
+        throw Exception("Cannot open " + file);
+    if (llvm::sys::path::extension(file) == ".mi" && stream.peek() == OPTIONS_LINE.front()) {
+        std::string line;
+        std::getline(stream, line);
+    }
+    Parser parser(stream);
+    try {
+        parser.parse();
+    } catch (Exception& e) {
+        throw Exception(located(file, e.position(), e.message()));
+    }
+    auto unit = std::dynamic_pointer_cast<UnitExpression>(parser.get_tree());
+    if (!unit)
+        throw Exception(file + " is not a unit");
+    return unit;
+}
+
+UnitBuilder::Unit& UnitBuilder::discover(const std::string& name, std::vector<std::string>& path) {
+    auto inProgress = std::find(path.begin(), path.end(), name);
+    if (inProgress != path.end()) {
+        std::string cycle;
+        for (auto it = inProgress; it != path.end(); ++it)
+            cycle += *it + " -> ";
+        throw Exception("Units use each other: " + cycle + name);
+    }
+    auto known = m_units.find(name);
+    if (known != m_units.end())
+        return known->second;
+
+    Unit unit;
+    unit.name = name;
+    for (const auto& directory : m_directories) {
+        llvm::SmallString<128> base(directory);
+        llvm::sys::path::append(base, name);
+        unit.object = (base + ".o").str();
+        unit.summary = (base + ".mi").str();
+        if (llvm::sys::fs::exists(base + ".mila")) {
+            unit.source = (base + ".mila").str();
+            break;
+        }
+        if (llvm::sys::fs::exists(unit.object) && llvm::sys::fs::exists(unit.summary))
+            break;
+        unit.object.clear();
+    }
+    if (unit.object.empty())
+        throw Exception("Unit not found: " + name);
+
+    // The summary keeps its old time when the interface stays the same, the object is always rewritten
+    unit.stale = !unit.source.empty() && (!llvm::sys::fs::exists(unit.object) ||
+                                          !llvm::sys::fs::exists(unit.summary) ||
+                                          modified(unit.source) > modified(unit.object) ||
+                                          recorded_options(unit.summary) != m_optionsKey);
+    unit.fromSource = unit.stale;
+    unit.tree = parse(unit.stale ? unit.source : unit.summary);
+    if (unit.tree->name() != name)
+        throw Exception((unit.stale ? unit.source : unit.summary) + " holds unit " + unit.tree->name() +
+                        " instead of " + name);
+
+    path.push_back(name);
+    for (const auto& used : unit.tree->uses())
+        unit.level = std::max(unit.level, discover(used, path).level + 1);
+    path.pop_back();
+
+    m_order.push_back(name);
+    return m_units[name] = std::move(unit);
+}
+
+std::vector<const UnitBuilder::Unit*> UnitBuilder::closure(const std::list<std::string>& uses) const {
+    std::set<std::string> reached;
+    std::vector<std::string> pending(uses.begin(), uses.end());
+    while (!pending.empty()) {
+        auto name = pending.back();
+        pending.pop_back();
+        if (reached.insert(name).second)
+            for (const auto& used : m_units.at(name).tree->uses())
+                pending.push_back(used);
+    }
+    std::vector<const Unit*> units;
+    for (const auto& name : m_order)
+        if (reached.count(name))
+            units.push_back(&m_units.at(name));
+    return units;
+}
+
+// Compiles level by level, the units of one level only depend on lower ones
+void UnitBuilder::compile_stale() {
+    unsigned levels = 0;
+    for (const auto& unit : m_units)
+        levels = std::max(levels, unit.second.level + 1);
+
+    for (unsigned level = 0; level < levels; level++) {
+        std::vector<Unit*> wave;
+        for (const auto& name : m_order) {
+            auto& unit = m_units.at(name);
+            if (unit.level != level || unit.source.empty())
+                continue;
+            // Summaries are only rewritten when the interface changes
+            for (const auto& used : unit.tree->uses())
+                if (modified(m_units.at(used).summary) > modified(unit.object))
+                    unit.stale = true;
+            if (!unit.stale)
+                continue;
+            if (!unit.fromSource) {
+                unit.tree = parse(unit.source);
+                unit.fromSource = true;
+            }
+            wave.push_back(&unit);
+        }
+        if (wave.empty())
+            continue;
+
+        {
+            llvm::ThreadPool pool(llvm::hardware_concurrency(m_options.jobs));
+            for (auto unit : wave)
+                pool.async([this, unit]() { compile(*unit); });
+            pool.wait();
+        }
+        // In a fixed order, whichever thread finished first
+        for (auto unit : wave) {
+            if (!unit->error.empty())
+                throw Exception(unit->error);
+            m_warnings.insert(m_warnings.end(), unit->warnings.begin(), unit->warnings.end());
+            unit->stale = false;
+            m_compiled++;
+        }
+    }
+}
+
+// Runs on a pool thread, so failures are kept in the unit instead of thrown
+void UnitBuilder::compile(Unit& unit) {
+    try {
+        CodeGenerator generator(merge(unit.tree, closure(unit.tree->uses())), m_options);
+        generator.generate_unit();
+        generator.optimize();
+        for (const auto& warning : generator.warnings())
+            unit.warnings.push_back(located(unit.source, warning.first, warning.second));
+
+        llvm::SmallString<128> temporary;
+        llvm::sys::fs::createUniquePath(unit.object + ".tmp-%%%%%%%%", temporary, false);
+        generator.write_object(std::string(temporary.str()));
+        if (auto errorCode = llvm::sys::fs::rename(temporary, unit.object)) {
+            llvm::sys::fs::remove(temporary);
+            throw Exception("Cannot write " + unit.object + ": " + errorCode.message());
+        }
+
+        // An unchanged interface keeps its timestamp, units using this one need not be recompiled
+        auto summary = OPTIONS_LINE + m_optionsKey + '\n' + unit.tree->summary();
+        auto old = llvm::MemoryBuffer::getFile(unit.summary);
+        if (!old || (*old)->getBuffer() != summary)
+            replace_file(unit.summary, summary);
+    } catch (Exception& e) {
+        unit.error = e.has_position() ? located(unit.source, e.position(), e.message()) : e.message();
+    }
+}
+
+std::shared_ptr<TopLevelExpression> UnitBuilder::merge(std::shared_ptr<TopLevelExpression> tree,
+                                                       const std::vector<const Unit*>& units) {
+    auto position = tree->position();
+    auto consts = std::make_shared<ConstExpression>(position);
+    auto vars = std::make_shared<VarExpression>(position);
+    std::list<std::shared_ptr<FunctionExpression>> functions;
+    std::list<Variable> externals;
+
+    std::map<std::string, std::string> owners;
+    auto declare = [&owners](const std::string& name, const std::string& unit) {
+        auto owner = owners.emplace(name, unit);
+        if (!owner.second)
+            throw Exception(name + " is declared by both " + owner.first->second + " and " + unit);
+    };
+    for (auto unit : units) {
+        const auto& exports = unit->tree->exports();
+        for (const auto& c : unit->tree->consts())
+            if (exports.count(c.first)) {
+                declare(c.first, unit->name);
+                consts->add(c.first, c.second);
+            }
+        for (const auto& v : unit->tree->vars())
+            if (exports.count(v.first)) {
+                declare(v.first, unit->name);
+                externals.push_back(v);
+            }
+        // Headers only, the bodies are in the unit's object
+        std::set<std::string> imported;
+        for (const auto& fun : unit->tree->functions()) {
+            if (!exports.count(fun->name()) || !imported.insert(fun->name()).second)
+                continue;
+            declare(fun->name(), unit->name);
+            std::list<Variable> args;
+            auto names = fun->arg_names();
+            auto types = fun->arg_types();
+            for (size_t i = 0; i < names.size(); i++)
+                args.push_back({names[i], types[i]});
+            functions.push_back(std::make_shared<FunctionExpression>(
+                    fun->name(), fun->return_type(), args, std::make_shared<ConstExpression>(fun->position()),
+                    std::make_shared<VarExpression>(fun->position()), nullptr, fun->position()));
+        }
+    }
+
+    auto own = [&owners](const std::string& name, const TextPosition& position) {
+        auto owner = owners.find(name);
+        if (owner != owners.end())
+            throw Exception(position, name + " is already declared by unit " + owner->second);
+    };
+    for (const auto& c : tree->consts()) {
+        own(c.first, c.second->position());
+        consts->add(c.first, c.second);
+    }
+    for (const auto& v : tree->vars()) {
+        own(v.first, position);
+        vars->add(v.first, v.second);
+    }
+    for (const auto& fun : tree->functions()) {
+        own(fun->name(), fun->position());
+        functions.push_back(fun);
+    }
+    externals.insert(externals.end(), tree->externals().begin(), tree->externals().end());
+
+    if (auto unit = std::dynamic_pointer_cast<UnitExpression>(tree))
+        return std::make_shared<UnitExpression>(unit->name(), unit->exports(), functions, consts, vars, position,
+                                                unit->uses(), externals);
+    return std::make_shared<TopLevelExpression>(functions, consts, vars, tree->body(), position, tree->uses(),
+                                                externals);
+}
+
+std::shared_ptr<TopLevelExpression> UnitBuilder::import(std::shared_ptr<TopLevelExpression> tree) {
+    std::vector<std::string> path;
+    for (const auto& used : tree->uses())
+        discover(used, path);
+    compile_stale();
+
+    auto units = closure(tree->uses());
+    m_objects.clear();
+    for (auto unit : units)
+        m_objects.push_back(unit->object);
+    return merge(tree, units);
+}
+
+void UnitBuilder::build(const std::string& name) {
+    std::vector<std::string> path;
+    auto& unit = discover(name, path);
+    if (unit.source.empty())
+        throw Exception("No source for unit " + name);
+    unit.stale = true;
+    compile_stale();
+}
@@ -0,0 +1,229 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+#include "../include/VM.h"
+#include "../include/Exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+// Computed goto where the compiler has it, a plain switch otherwise
+#ifdef __GNUC__
+#define VM_THREADED
+#endif
+
+#ifdef VM_THREADED
+#define DISPATCH() goto *labels[(ins = pc++)->op]
+#define TARGET(op) op:
+#else
+#define DISPATCH() goto dispatch
+#define TARGET(op) case op:
+#endif
+
+
+// x div 0 and INT_MIN div -1 trap with SIGFPE like the native idiv does
+static void check_division(int32_t dividend, int32_t divisor) {
+    if (divisor == 0 || (divisor == -1 && dividend == std::numeric_limits<int32_t>::min()))
+        std::raise(SIGFPE);
+}
+
+// Integers wrap around like the native code does
+static int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+Value* VM::window(size_t base, const BytecodeFunction& function) {
+    auto end = base + function.registers;
+    if (end > m_stack.size())
+        m_stack.resize(std::max(end, m_stack.size() * 2));
+    return m_stack.data() + base;
+}
+
+int VM::run() {
+#ifdef VM_THREADED
+    // Same order as Opcode
+    static void* const labels[] = {
+            &&OP_MOVE, &&OP_LOAD_INT, &&OP_LOAD_CONST, &&OP_LOAD_GLOBAL, &&OP_STORE_GLOBAL,
+            &&OP_ADD, &&OP_SUB, &&OP_MUL, &&OP_DIV, &&OP_MOD, &&OP_INC, &&OP_DEC, &&OP_NEG, &&OP_NOT,
+            &&OP_NOT_BOOLEAN, &&OP_AND, &&OP_OR, &&OP_EQ, &&OP_NE, &&OP_LT, &&OP_LE, &&OP_GT, &&OP_GE,
+            &&OP_FADD, &&OP_FSUB, &&OP_FMUL, &&OP_FDIV, &&OP_FMOD, &&OP_FNEG,
+            &&OP_FEQ, &&OP_FNE, &&OP_FLT, &&OP_FLE, &&OP_FGT, &&OP_FGE, &&OP_TO_DOUBLE,
+            &&OP_JUMP, &&OP_JUMP_IF_ZERO, &&OP_JUMP_IF_NOT_ZERO, &&OP_JUMP_IF_EQ, &&OP_JUMP_IF_NE,
+            &&OP_JUMP_IF_LT, &&OP_JUMP_IF_LE, &&OP_JUMP_IF_GT, &&OP_JUMP_IF_GE,
+            &&OP_CALL, &&OP_TAIL_CALL, &&OP_RETURN, &&OP_RETURN_VOID,
+            &&OP_WRITE_INT, &&OP_WRITELN_INT, &&OP_WRITE_DOUBLE, &&OP_WRITELN_DOUBLE, &&OP_WRITE_STRING,
+            &&OP_READ_INT, &&OP_READ_DOUBLE
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == OP_COUNT, "Every opcode needs a label");
+#endif
+
+    const auto& functions = m_program.functions;
+    const auto* constants = m_program.constants.data();
+    auto globalValues = m_program.globals;
+    auto* globals = globalValues.data();
+
+    const auto& main = functions[m_program.main];
+    m_stack.assign(std::max<size_t>(main.registers, 1 << 12), Value());
+    m_frames.clear();
+    m_frames.push_back({&main, nullptr, 0, 0});
+    Value* r = window(0, main);
+    const Instruction* code = main.code.data();     // of the current function, jump targets are relative to it
+    const Instruction* pc = code;
+    const Instruction* ins;
+
+#ifdef VM_THREADED
+    DISPATCH();
+#else
+dispatch:
+    ins = pc++;
+    switch (ins->op) {
+#endif
+
+    TARGET(OP_MOVE) r[ins->a] = r[ins->b]; DISPATCH();
+    TARGET(OP_LOAD_INT) r[ins->a].i = ins->value; DISPATCH();
+    TARGET(OP_LOAD_CONST) r[ins->a] = constants[ins->value]; DISPATCH();
+    TARGET(OP_LOAD_GLOBAL) r[ins->a] = globals[ins->value]; DISPATCH();
+    TARGET(OP_STORE_GLOBAL) globals[ins->value] = r[ins->a]; DISPATCH();
+
+    TARGET(OP_ADD) r[ins->a].i = wrap(uint32_t(r[ins->b].i) + uint32_t(r[ins->c].i)); DISPATCH();
+    TARGET(OP_SUB) r[ins->a].i = wrap(uint32_t(r[ins->b].i) - uint32_t(r[ins->c].i)); DISPATCH();
+    TARGET(OP_MUL) r[ins->a].i = wrap(uint32_t(r[ins->b].i) * uint32_t(r[ins->c].i)); DISPATCH();
+    TARGET(OP_DIV)
+        check_division(r[ins->b].i, r[ins->c].i);
+        r[ins->a].i = r[ins->b].i / r[ins->c].i;
+        DISPATCH();
+    TARGET(OP_MOD)
+        check_division(r[ins->b].i, r[ins->c].i);
+        r[ins->a].i = r[ins->b].i % r[ins->c].i;
+        DISPATCH();
+    TARGET(OP_INC) r[ins->a].i = wrap(uint32_t(r[ins->a].i) + 1); DISPATCH();
+    TARGET(OP_DEC) r[ins->a].i = wrap(uint32_t(r[ins->a].i) - 1); DISPATCH();
+    TARGET(OP_NEG) r[ins->a].i = wrap(0u - uint32_t(r[ins->b].i)); DISPATCH();
+    TARGET(OP_NOT) r[ins->a].i = ~r[ins->b].i; DISPATCH();
+    TARGET(OP_NOT_BOOLEAN) r[ins->a].i = r[ins->b].i ^ 1; DISPATCH();
+    TARGET(OP_AND) r[ins->a].i = r[ins->b].i & r[ins->c].i; DISPATCH();
+    TARGET(OP_OR) r[ins->a].i = r[ins->b].i | r[ins->c].i; DISPATCH();
+    TARGET(OP_EQ) r[ins->a].i = r[ins->b].i == r[ins->c].i; DISPATCH();
+    TARGET(OP_NE) r[ins->a].i = r[ins->b].i != r[ins->c].i; DISPATCH();
+    TARGET(OP_LT) r[ins->a].i = r[ins->b].i < r[ins->c].i; DISPATCH();
+    TARGET(OP_LE) r[ins->a].i = r[ins->b].i <= r[ins->c].i; DISPATCH();
+    TARGET(OP_GT) r[ins->a].i = r[ins->b].i > r[ins->c].i; DISPATCH();
+    TARGET(OP_GE) r[ins->a].i = r[ins->b].i >= r[ins->c].i; DISPATCH();
+
+    TARGET(OP_FADD) r[ins->a].d = r[ins->b].d + r[ins->c].d; DISPATCH();
+    TARGET(OP_FSUB) r[ins->a].d = r[ins->b].d - r[ins->c].d; DISPATCH();
+    TARGET(OP_FMUL) r[ins->a].d = r[ins->b].d * r[ins->c].d; DISPATCH();
+    TARGET(OP_FDIV) r[ins->a].d = r[ins->b].d / r[ins->c].d; DISPATCH();
+    TARGET(OP_FMOD) r[ins->a].d = std::fmod(r[ins->b].d, r[ins->c].d); DISPATCH();
+    TARGET(OP_FNEG) r[ins->a].d = -r[ins->b].d; DISPATCH();
+    TARGET(OP_FEQ) r[ins->a].i = r[ins->b].d == r[ins->c].d; DISPATCH();
+    // ordered, so false for NaN
+    TARGET(OP_FNE) r[ins->a].i = r[ins->b].d < r[ins->c].d || r[ins->b].d > r[ins->c].d; DISPATCH();
+    TARGET(OP_FLT) r[ins->a].i = r[ins->b].d < r[ins->c].d; DISPATCH();
+    TARGET(OP_FLE) r[ins->a].i = r[ins->b].d <= r[ins->c].d; DISPATCH();
+    TARGET(OP_FGT) r[ins->a].i = r[ins->b].d > r[ins->c].d; DISPATCH();
+    TARGET(OP_FGE) r[ins->a].i = r[ins->b].d >= r[ins->c].d; DISPATCH();
+    TARGET(OP_TO_DOUBLE) r[ins->a].d = r[ins->b].i; DISPATCH();
+
+    TARGET(OP_JUMP) pc = code + ins->value; DISPATCH();
+    TARGET(OP_JUMP_IF_ZERO)
+        if (!r[ins->a].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_NOT_ZERO)
+        if (r[ins->a].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_EQ)
+        if (r[ins->a].i == r[ins->b].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_NE)
+        if (r[ins->a].i != r[ins->b].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_LT)
+        if (r[ins->a].i < r[ins->b].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_LE)
+        if (r[ins->a].i <= r[ins->b].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_GT)
+        if (r[ins->a].i > r[ins->b].i)
+            pc = code + ins->value;
+        DISPATCH();
+    TARGET(OP_JUMP_IF_GE)
+        if (r[ins->a].i >= r[ins->b].i)
+            pc = code + ins->value;
+        DISPATCH();
+
+    TARGET(OP_CALL) {
+        const auto& callee = functions[ins->b];
+        auto callerBase = m_frames.back().base;
+        auto base = callerBase + m_frames.back().function->registers;
+        m_frames.push_back({&callee, pc, base, ins->a});
+        // The stack may move when it grows
+        r = window(base, callee);
+        auto caller = m_stack.data() + callerBase;
+        std::copy(caller + ins->c, caller + ins->c + callee.arguments, r);
+        std::fill(r + callee.arguments, r + callee.registers, Value());
+        pc = code = callee.code.data();
+        DISPATCH();
+    }
+    TARGET(OP_TAIL_CALL) {
+        const auto& callee = functions[ins->b];
+        auto& frame = m_frames.back();
+        auto arguments = ins->c;
+        r = window(frame.base, callee);
+        std::memmove(r, r + arguments, callee.arguments * sizeof(Value));
+        std::fill(r + callee.arguments, r + callee.registers, Value());
+        frame.function = &callee;
+        pc = code = callee.code.data();
+        DISPATCH();
+    }
+    TARGET(OP_RETURN) {
+        auto result = r[ins->a];
+        auto frame = m_frames.back();
+        m_frames.pop_back();
+        r = m_stack.data() + m_frames.back().base;
+        r[frame.result] = result;
+        code = m_frames.back().function->code.data();
+        pc = frame.returnTo;
+        DISPATCH();
+    }
+    TARGET(OP_RETURN_VOID) {
+        auto frame = m_frames.back();
+        m_frames.pop_back();
+        if (m_frames.empty())
+            goto finished;
+        r = m_stack.data() + m_frames.back().base;
+        code = m_frames.back().function->code.data();
+        pc = frame.returnTo;
+        DISPATCH();
+    }
+
+    TARGET(OP_WRITE_INT) std::printf("%d", r[ins->a].i); DISPATCH();
+    TARGET(OP_WRITELN_INT) std::printf("%d\n", r[ins->a].i); DISPATCH();
+    TARGET(OP_WRITE_DOUBLE) std::printf("%lf", r[ins->a].d); DISPATCH();
+    TARGET(OP_WRITELN_DOUBLE) std::printf("%lf\n", r[ins->a].d); DISPATCH();
+    TARGET(OP_WRITE_STRING) std::fputs(m_program.strings[ins->value].c_str(), stdout); DISPATCH();
+    TARGET(OP_READ_INT) std::scanf("%d[^\n]", &r[ins->a].i); DISPATCH();
+    TARGET(OP_READ_DOUBLE) std::scanf("%lf[^\n]", &r[ins->a].d); DISPATCH();
+
+#ifndef VM_THREADED
+        default:
+            throw Exception("Invalid opcode");
+    }
+#endif
+
+finished:
+    std::fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,119 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+// Compilations on many threads at once must produce what they do one by one,
+// and failures must end up in the diagnostics.
+
+#include "Compilation.h"
+
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static const std::vector<std::string> sources = {
+        "program fib;\n"
+        "var i, t : integer;\n"
+        "function fib(n : integer) : integer;\n"
+        "begin\n"
+        "    if n < 2 then fib := n else fib := fib(n - 1) + fib(n - 2);\n"
+        "end;\n"
+        "function work(n : integer) : integer;\n"
+        "var i, s : integer;\n"
+        "begin\n"
+        "    s := 0;\n"
+        "    for i := 0 to n do s := s + i mod 13;\n"
+        "    work := s;\n"
+        "end;\n"
+        "begin\n"
+        "    t := 0;\n"
+        "    for i := 0 to 300 do t := t + work(200);\n"
+        "    writeln(t);\n"
+        "    writeln(fib(20));\n"
+        "end.\n",
+
+        "program c;\n"
+        "var n, calls : integer;\n"
+        "function expensive(x : integer) : integer;\n"
+        "begin\n"
+        "    calls := calls + 1;\n"
+        "    expensive := x;\n"
+        "end;\n"
+        "begin\n"
+        "    calls := 0;\n"
+        "    n := 1;\n"
+        "    if (n > 0) and (expensive(n) = 1) then writeln('yes');\n"
+        "    writeln(calls);\n"
+        "end.\n",
+
+        "program d;\n"
+        "const N = 10;\n"
+        "var i : integer;\n"
+        "var d : double;\n"
+        "begin\n"
+        "    d := 0.5;\n"
+        "    for i := 1 to N do d := d * 1.5 + i;\n"
+        "    writeln(d);\n"
+        "    while i > 0 do begin write(i); i := i - 3; end;\n"
+        "end.\n",
+};
+
+static int failures = 0;
+
+static void expect(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+int main() {
+    Options options;
+    options.optLevel = OPT_2;
+
+    std::vector<std::string> serial;
+    for (const auto& source : sources) {
+        Compilation compilation(source, options);
+        expect(compilation.emit(), "a valid program compiles");
+        serial.emplace_back(compilation.object().begin(), compilation.object().end());
+    }
+
+    const int threads = 8, rounds = 5;
+    int mismatches = 0;
+    std::mutex mutex;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]() {
+            for (int round = 0; round < rounds; round++)
+                for (size_t i = 0; i < sources.size(); i++) {
+                    auto index = (i + t) % sources.size();
+                    Compilation compilation(sources[index], options);
+                    compilation.emit();
+                    if (std::string(compilation.object().begin(), compilation.object().end()) != serial[index]) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        mismatches++;
+                    }
+                }
+        });
+    for (auto& worker : workers)
+        worker.join();
+    expect(mismatches == 0, std::to_string(mismatches) + " concurrent compilations differ from the serial ones");
+    std::cout << threads * rounds * sources.size() << " compilations on " << threads << " threads, "
+              << mismatches << " differing" << std::endl;
+
+    Compilation bad("program p;\nbegin\n    x := 1;\nend.\n");
+    expect(!bad.emit() && bad.failed(), "an unknown identifier fails");
+    expect(!bad.diagnostics().empty() && bad.diagnostics().front().error &&
+           bad.diagnostics().front().position.line == 3, "the error is reported at its line");
+
+    Compilation taken("program p; begin writeln(1); end.");
+    expect(taken.parse() && !taken.module(), "no module before generating");
+    expect(taken.generate() && taken.module(), "a module after generating");
+    expect(bool(taken.take_module()) && !taken.module(), "the module can be taken");
+    expect(!taken.emit() && taken.failed(), "nothing is left to emit after taking the module");
+
+    return failures != 0;
+}
@@ -0,0 +1,103 @@
+//
+// Created by askar on 19/10/2026.
+//
+
+// Kernel functions are called through plain pointers, their writes reach the
+// output callbacks and bad lookups throw. Also prints what a call costs
+// next to a native one.
+
+#include "Exception.h"
+#include "Kernel.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+
+static int failures = 0;
+
+static void expect(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+template<typename Step>
+static std::string error_of(Step step) {
+    try {
+        step();
+    } catch (Exception& e) {
+        return e.message();
+    }
+    return "";
+}
+
+static void integer(void* context, int value, bool newline) {
+    *static_cast<std::string*>(context) += std::to_string(value) + (newline ? "\n" : " ");
+}
+
+static void real(void* context, double value, bool newline) {
+    *static_cast<std::string*>(context) += std::to_string(value) + (newline ? "\n" : " ");
+}
+
+static void text(void* context, const char* text) {
+    *static_cast<std::string*>(context) += text;
+}
+
+__attribute__((noinline)) static double native(double x, double y) {
+    return x * y + 1.0;
+}
+
+int main() {
+    const char* source =
+            "program k;\n"
+            "var counter : integer;\n"
+            "function fma1(x : double; y : double) : double;\n"
+            "begin fma1 := x * y + 1.0; end;\n"
+            "function fact(n : integer) : integer;\n"
+            "begin if n < 2 then fact := 1 else fact := n * fact(n - 1); end;\n"
+            "procedure report(n : integer);\n"
+            "begin counter := counter + 1; write(n); writeln(counter); writeln(2.5); write('a'); writeln('b'); end;\n"
+            "begin end.\n";
+    Options options;
+    options.optLevel = OPT_2;
+
+    std::string log;
+    Kernel::Output output;
+    output.context = &log;
+    output.integer = integer;
+    output.real = real;
+    output.text = text;
+    Kernel kernel(source, options, output);
+
+    auto fact = kernel.function<int(int)>("fact");
+    auto fma1 = kernel.function<double(double, double)>("fma1");
+    auto report = kernel.function<void(int)>("report");
+    expect(fact(10) == 3628800, "fact(10)");
+    expect(fma1(2, 3) == 7, "fma1(2, 3)");
+    report(7);
+    report(8);
+    expect(log == "7 1\n2.500000\nab\n8 2\n2.500000\nab\n", "writes reach the callbacks, got:\n" + log);
+
+    expect(error_of([&]() { kernel.function<int(double)>("fact"); }) == "fact is int(int), not int(double)",
+           "a wrong signature is refused");
+    expect(error_of([&]() { kernel.function<int(int)>("nope"); }) == "No function nope in the kernel",
+           "an unknown function is refused");
+    expect(!error_of([]() { Kernel("program k; begin x := 1; end."); }).empty(), "a bad source throws");
+
+    const long calls = 100000000;
+    double sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; i++)
+        sum += fma1(i * 1e-9, 1.5);
+    auto middle = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; i++)
+        sum += native(i * 1e-9, 1.5);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "kernel " << std::chrono::duration<double, std::nano>(middle - start).count() / calls
+              << " ns/call, native " << std::chrono::duration<double, std::nano>(end - middle).count() / calls
+              << " ns/call (" << sum << ")" << std::endl;
+
+    return failures != 0;
+}
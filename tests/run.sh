@@ -0,0 +1,38 @@
+#!/bin/sh
+# Runs every tests/*.mila through the VM, the JIT and native code at the
+# optimization levels and variable modes the code generator has, and with
+# parallel code generation of multiversioned functions, and checks the output
+# against the .out file next to it.
+#
+# usage: tests/run.sh <compiler>
+
+compiler=${1:?usage: $0 <compiler>}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+status=0
+check() {
+    if ! "$@" < /dev/null 2> "$work/err" | diff -u "$expected" - > "$work/diff"; then
+        echo "FAIL $(basename "$program"): $*"
+        cat "$work/diff" "$work/err"
+        status=1
+    fi
+}
+
+for program in "$(dirname "$0")"/*.mila; do
+    expected=${program%.mila}.out
+    check "$compiler" --vm "$program"
+    for mode in "" -fssa "-j2 -fmultiversion=auto"; do
+        for level in -O0 -O2; do
+            check "$compiler" --run $mode $level "$program"
+            if "$compiler" $mode $level "$program" "$work/out" > /dev/null 2> "$work/err"; then
+                check "$work/out.bin"
+            else
+                echo "FAIL $(basename "$program"): cannot compile with $mode $level"
+                cat "$work/err"
+                status=1
+            fi
+        done
+    done
+done
+exit $status